@@ -0,0 +1,257 @@
+#ifndef TABLE_ARRAYPART_H
+#define TABLE_ARRAYPART_H
+
+#include "HashWrapper.h"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+/// Table 的 array 部分，每个位置是一个 shared_ptr<Value>，空位置为 nullptr。
+/// 连续模式下是一整块内存，扩大时用 realloc 或 mremap；分页模式下由固定大小的页组成，
+/// 扩大只添加页，缩小释放页，不需要在新旧两块内存之间复制。
+/// 两种模式用同一套下标计算：第 i 个位置是 pages[i >> shift][i & mask]，连续模式只有一页
+class ArrayPart {
+public:
+    static constexpr unsigned PAGE_LOG2 = 16; // slots per page, 1 MiB pages
+    static constexpr unsigned long PAGE = 1ul << PAGE_LOG2;
+
+private:
+    /// 每块内存前面的记录，保存分配的字节数，释放与改变大小时不需要知道位置个数
+    struct alignas(16) Header {
+        unsigned long bytes;
+    };
+
+    static constexpr unsigned long MMAP_THRESHOLD = 1ul << 20; // blocks of at least this many bytes are mapped
+    static constexpr unsigned MAX_SHIFT = 63; // a contiguous part is a single page, as long as it has < 2^63 slots
+
+    std::vector<std::shared_ptr<Value>*> pages;
+    unsigned long slots;
+    unsigned shift;
+    unsigned long mask;
+    bool paged;
+
+    static Header* header_of(std::shared_ptr<Value>* block) {
+        return reinterpret_cast<Header*>(block) - 1;
+    }
+
+    static unsigned long bytes_for(unsigned long n) {
+        return sizeof(Header) + n * sizeof(std::shared_ptr<Value>);
+    }
+
+    /// 分配 n 个位置，每个位置都是 nullptr。全 0 的 shared_ptr 就是 nullptr，所以只需要清零的内存，
+    /// 大块直接用 mmap 分配，之后可以用 mremap 改变大小
+    static std::shared_ptr<Value>* allocate(unsigned long n) {
+        auto bytes = bytes_for(n);
+        void* memory = bytes >= MMAP_THRESHOLD
+            ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+            : std::calloc(1, bytes);
+        if (memory == nullptr || memory == MAP_FAILED)
+            throw std::bad_alloc();
+        auto header = static_cast<Header*>(memory);
+        header->bytes = bytes;
+        return reinterpret_cast<std::shared_ptr<Value>*>(header + 1);
+    }
+
+    static void free_memory(Header* header) {
+        if (header->bytes >= MMAP_THRESHOLD)
+            munmap(header, header->bytes);
+        else
+            std::free(header);
+    }
+
+    /// 释放一块内存，其中的 value 一并释放
+    static void release(std::shared_ptr<Value>* block) {
+        std::destroy_n(block, (header_of(block)->bytes - sizeof(Header)) / sizeof(std::shared_ptr<Value>));
+        free_memory(header_of(block));
+    }
+
+    /// 把一块内存改为 n 个位置，前面的位置保持不变，新的位置为 nullptr，去掉的位置必须已经是 nullptr。
+    /// shared_ptr 不指向自身，按字节搬动就是合法的移动，映射的块由 mremap 换页表，不复制内容
+    static std::shared_ptr<Value>* reallocate(std::shared_ptr<Value>* block, unsigned long n) {
+        auto header = header_of(block);
+        auto old_bytes = header->bytes, bytes = bytes_for(n);
+
+        if ((old_bytes >= MMAP_THRESHOLD) != (bytes >= MMAP_THRESHOLD)) {
+            // crossing the threshold copies once
+            auto moved = allocate(n);
+            std::memcpy((void*)moved, (void*)block, std::min(old_bytes, bytes) - sizeof(Header));
+            free_memory(header);
+            return moved;
+        }
+
+        void* memory;
+        if (bytes >= MMAP_THRESHOLD) {
+#ifdef __linux__
+            // pages the mapping gains come zeroed
+            memory = mremap(header, old_bytes, bytes, MREMAP_MAYMOVE);
+            if (memory == MAP_FAILED)
+                throw std::bad_alloc();
+#else
+            auto moved = allocate(n);
+            std::memcpy((void*)moved, (void*)block, std::min(old_bytes, bytes) - sizeof(Header));
+            free_memory(header);
+            return moved;
+#endif
+        } else {
+            memory = std::realloc(header, bytes);
+            if (memory == nullptr)
+                throw std::bad_alloc();
+            if (bytes > old_bytes)
+                std::memset(static_cast<char*>(memory) + old_bytes, 0, bytes - old_bytes);
+        }
+
+        header = static_cast<Header*>(memory);
+        header->bytes = bytes;
+        return reinterpret_cast<std::shared_ptr<Value>*>(header + 1);
+    }
+
+    /// 把位置 from 的内容按字节移到空位置 to，from 变为 nullptr
+    void relocate(unsigned long to, unsigned long from) {
+        std::memcpy((void*)&(*this)[to], (void*)&(*this)[from], sizeof(std::shared_ptr<Value>));
+        std::memset((void*)&(*this)[from], 0, sizeof(std::shared_ptr<Value>));
+    }
+
+    void set_geometry() {
+        shift = paged ? PAGE_LOG2 : MAX_SHIFT;
+        mask = (1ul << shift) - 1;
+    }
+
+public:
+    explicit ArrayPart(unsigned long slots = 1, bool paged = false): slots(slots), paged(paged) {
+        set_geometry();
+        if (!paged) {
+            pages.push_back(allocate(slots));
+            return;
+        }
+        // only a part smaller than a page has a smaller first page
+        for (unsigned long i = 0; i < std::max(slots, 1ul); i += PAGE)
+            pages.push_back(allocate(std::min(PAGE, slots)));
+    }
+
+    ArrayPart(const ArrayPart&) = delete;
+    ArrayPart& operator = (const ArrayPart&) = delete;
+
+    ArrayPart(ArrayPart &&other) noexcept: ArrayPart(0) {
+        swap(other);
+    }
+
+    ArrayPart& operator = (ArrayPart &&other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~ArrayPart() {
+        for (auto page: pages)
+            release(page);
+    }
+
+    void swap(ArrayPart &other) noexcept {
+        std::swap(pages, other.pages);
+        std::swap(slots, other.slots);
+        std::swap(shift, other.shift);
+        std::swap(mask, other.mask);
+        std::swap(paged, other.paged);
+    }
+
+    std::shared_ptr<Value>& operator [] (unsigned long i) {
+        return pages[i >> shift][i & mask];
+    }
+
+    const std::shared_ptr<Value>& operator [] (unsigned long i) const {
+        return pages[i >> shift][i & mask];
+    }
+
+    [[nodiscard]] unsigned long size() const {
+        return slots;
+    }
+
+    [[nodiscard]] bool is_paged() const {
+        return paged;
+    }
+
+    /// 各块内存的字节数，包括块前的记录。这些内存由 calloc 或 mmap 分配，不经过 operator new
+    [[nodiscard]] unsigned long allocated_bytes() const {
+        unsigned long bytes = 0;
+        for (auto page: pages)
+            bytes += header_of(page)->bytes;
+        return bytes;
+    }
+
+    /// 扩大到 n 个位置，原来的位置 i 移到 i + offset，n >= size() + offset，其余位置为 nullptr
+    void grow(unsigned long n, unsigned long offset) {
+        auto old = slots;
+        if (!paged) {
+            pages[0] = reallocate(pages[0], n);
+            slots = n;
+            if (offset != 0) {
+                std::memmove((void*)(pages[0] + offset), (void*)pages[0], old * sizeof(std::shared_ptr<Value>));
+                std::memset((void*)pages[0], 0, std::min(offset, old) * sizeof(std::shared_ptr<Value>));
+            }
+            return;
+        }
+
+        pages[0] = reallocate(pages[0], std::min(PAGE, n));
+        while (pages.size() * PAGE < n)
+            pages.push_back(allocate(PAGE));
+        slots = n;
+        if (offset == 0)
+            return;
+
+        if (offset % PAGE == 0 && old % PAGE == 0) {
+            // whole pages: the empty pages just added go to the front of the directory
+            std::rotate(pages.begin(), pages.end() - offset / PAGE, pages.end());
+            return;
+        }
+        for (auto i = old; i-- > 0;)
+            relocate(i + offset, i);
+    }
+
+    /// 缩小到 n 个位置，只保留原来的 [offset, offset + n)，移到 [0, n)。其余位置必须已经是 nullptr
+    void shrink(unsigned long n, unsigned long offset) {
+        if (!paged) {
+            if (offset != 0) {
+                std::memmove((void*)pages[0], (void*)(pages[0] + offset), n * sizeof(std::shared_ptr<Value>));
+                std::memset((void*)(pages[0] + n), 0, std::min(offset, slots - n) * sizeof(std::shared_ptr<Value>));
+            }
+            pages[0] = reallocate(pages[0], n);
+            slots = n;
+            return;
+        }
+
+        if (offset % PAGE == 0) {
+            // whole pages: drop them from the front of the directory
+            for (unsigned long p = 0; p < offset / PAGE; p++)
+                release(pages[p]);
+            pages.erase(pages.begin(), pages.begin() + offset / PAGE);
+        } else {
+            for (unsigned long i = 0; i < n; i++)
+                relocate(i, i + offset);
+        }
+
+        auto keep = (n + PAGE - 1) / PAGE;
+        for (auto p = keep; p < pages.size(); p++)
+            release(pages[p]);
+        pages.resize(keep);
+        pages[0] = reallocate(pages[0], std::min(PAGE, n));
+        slots = n;
+    }
+
+    /// 切换连续与分页模式，位置与内容不变
+    void set_paged(bool enabled) {
+        if (enabled == paged)
+            return;
+        ArrayPart other(slots, enabled);
+        for (unsigned long i = 0; i < slots; i++)
+            std::memcpy((void*)&other[i], (void*)&(*this)[i], sizeof(std::shared_ptr<Value>));
+        // the contents now belong to other, free the old blocks without destroying them
+        for (auto page: pages)
+            free_memory(header_of(page));
+        pages.clear();
+        swap(other);
+    }
+};
+
+#endif //TABLE_ARRAYPART_H
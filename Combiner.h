@@ -0,0 +1,133 @@
+#ifndef TABLE_COMBINER_H
+#define TABLE_COMBINER_H
+
+#include "Table.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+/// 批量聚合：每个线程写自己的 Table，互不竞争；最后由 merge() 把它们合成一个 Table。
+/// 同一个 key 出现在多个线程的 Table 中时，用 combine(into, from) 把 from 并入 into
+class Combiner {
+public:
+    using Combine = std::function<void(Value &into, const Value &from)>;
+
+private:
+    Combine combine;
+    Layout layout;
+    uint64_t id; // tells the thread-local caches of different combiners apart
+
+    std::mutex lock;
+    std::unordered_map<std::thread::id, std::unique_ptr<Table>> tables;
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> ids{ 0 };
+        return ++ids;
+    }
+
+    static unsigned bit(unsigned long x) {
+        return MAX_BIT - __builtin_clzll(x) - 1;
+    }
+
+    template<class F>
+    static void parallel(unsigned n, F f) {
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < n; i++)
+            threads.emplace_back(f, i);
+        f(0);
+        for (auto &thread: threads)
+            thread.join();
+    }
+
+public:
+    explicit Combiner(Combine combine, Layout layout = CHAINED):
+        combine(std::move(combine)), layout(layout), id(next_id()) {}
+
+    Combiner(const Combiner&) = delete;
+    Combiner& operator = (const Combiner&) = delete;
+
+    /// 当前线程的 Table，第一次调用时创建。只有当前线程可以修改它
+    Table& local() {
+        // the last combiner this thread used, so that the common case doesn't take the lock
+        static thread_local std::pair<uint64_t, Table*> cache{ 0, nullptr };
+        if (cache.first == id)
+            return *cache.second;
+
+        std::lock_guard<std::mutex> guard(lock);
+        auto &table = tables[std::this_thread::get_id()];
+        if (table == nullptr)
+            table = std::make_unique<Table>(0, 1, layout);
+        cache = { id, table.get() };
+        return *table;
+    }
+
+    /// 把所有线程的 Table 合并到空的 result 中，之后这些 Table 被清空。调用时其他线程不能再写入。
+    /// key 按 hash 分成 threads 个分区，各分区并行地合并，result 按合并后的大小一次分配好，
+    /// 再由 Table::fill 并行地填入
+    void merge(Table &result, unsigned threads = std::thread::hardware_concurrency()) {
+        std::vector<std::unique_ptr<Table>> locals;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto &[thread, table]: tables)
+                locals.push_back(std::move(table));
+            tables.clear();
+        }
+        id = next_id(); // forget the cached pointers to the tables taken above
+
+        auto partitions = std::max(1u, threads);
+        using Bucket = std::vector<std::pair<Key, std::shared_ptr<Value>>>;
+
+        // split every thread's table by partition
+        std::vector<std::vector<Bucket>> buckets(locals.size(), std::vector<Bucket>(partitions));
+        std::atomic<unsigned> next{ 0 };
+        parallel(std::min<unsigned>(partitions, std::max<size_t>(1, locals.size())), [&](unsigned) {
+            for (unsigned l; (l = next++) < locals.size();) {
+                locals[l]->for_each([&](const Key &key, std::shared_ptr<Value> &value) {
+                    buckets[l][Table::partition_of(key.hash(), partitions)].emplace_back(key, value);
+                });
+                locals[l].reset();
+            }
+        });
+
+        // combine each partition on its own, the parts never see each other's keys
+        std::vector<std::unique_ptr<Table>> parts(partitions);
+        std::vector<std::vector<Integer>> ints(partitions);
+        std::vector<unsigned long> sizes(partitions);
+        parallel(partitions, [&](unsigned p) {
+            unsigned long total = 0;
+            for (auto &bucket: buckets)
+                total += bucket[p].size();
+            parts[p] = std::make_unique<Table>(0, bit(std::max(1ul, total)) + 1, layout);
+
+            auto &part = *parts[p];
+            for (auto &bucket: buckets) {
+                for (auto &[key, value]: bucket[p]) {
+                    auto found = part.find(key);
+                    if (found != nullptr)
+                        combine(*found, *value);
+                    else
+                        part.insert(key, value), sizes[p]++;
+                }
+                Bucket().swap(bucket[p]);
+            }
+
+            part.for_each([&](const Key &key, std::shared_ptr<Value>&) {
+                if (key.type() == INT)
+                    ints[p].push_back(key.item());
+            });
+        });
+
+        // size the result once, then move the combined entries in
+        std::vector<Integer> keys;
+        unsigned long total = 0;
+        for (unsigned p = 0; p < partitions; p++) {
+            keys.insert(keys.end(), ints[p].begin(), ints[p].end());
+            total += sizes[p];
+        }
+        result.reserve(keys, total);
+        result.fill(parts, partitions);
+    }
+};
+
+#endif //TABLE_COMBINER_H
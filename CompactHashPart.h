@@ -0,0 +1,264 @@
+#ifndef TABLE_COMPACTHASHPART_H
+#define TABLE_COMPACTHASHPART_H
+
+#include "HashPart.h"
+#include <cstring>
+
+/// 仿照 Python 的 compact dict：entry 按插入顺序紧密地存放在一个数组中，hash 索引只保存 entry 的下标，
+/// 下标按索引大小选用 8/16/32/64 位。删除时留下墓碑，墓碑超过一半时整理。
+/// 设置容量上限后作为 CLOCK 缓存使用，新 entry 直接占用被淘汰的 entry 的位置
+class CompactHashPart: public IHashPart {
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<Value> value; // nullptr for a tombstone
+        bool referenced; // the CLOCK bit, only kept when bounded
+    };
+
+    // Index slot values: EMPTY, DUMMY (the entry was erased), or the entry position + 2.
+    static const uint64_t EMPTY = 0;
+    static const uint64_t DUMMY = 1;
+
+    static const unsigned MIN_INDEX_LOG2 = 3;
+
+    std::vector<Entry> entries;
+    std::vector<uint8_t> index;
+    unsigned width; // bytes per index slot
+    unsigned shift; // 64 - log2(number of index slots)
+    unsigned long used; // index slots that are not EMPTY
+    unsigned long count; // live entries
+    unsigned long capacity;
+
+    unsigned long bound; // 0 if entries are never evicted
+    unsigned long hand; // the clock hand, a position in entries
+
+    [[nodiscard]] unsigned long slots() const {
+        return 1ul << (64 - shift);
+    }
+
+    [[nodiscard]] unsigned long mask() const {
+        return slots() - 1;
+    }
+
+    /// 索引最多引用 2/3 个 slot 的 entry，保证探测总能遇到空位
+    [[nodiscard]] unsigned long usable() const {
+        return slots() * 2 / 3;
+    }
+
+    [[nodiscard]] unsigned long home(Hash h) const {
+        return (h * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+
+    [[nodiscard]] uint64_t get(unsigned long i) const {
+        switch (width) {
+            case 1: return index[i];
+            case 2: { uint16_t v; memcpy(&v, &index[i * 2], 2); return v; }
+            case 4: { uint32_t v; memcpy(&v, &index[i * 4], 4); return v; }
+            default: { uint64_t v; memcpy(&v, &index[i * 8], 8); return v; }
+        }
+    }
+
+    void set(unsigned long i, uint64_t v) {
+        switch (width) {
+            case 1: index[i] = v; break;
+            case 2: { uint16_t w = v; memcpy(&index[i * 2], &w, 2); break; }
+            case 4: { uint32_t w = v; memcpy(&index[i * 4], &w, 4); break; }
+            default: memcpy(&index[i * 8], &v, 8); break;
+        }
+    }
+
+    /// 返回引用 key 的索引 slot，不存在时返回 slots()
+    [[nodiscard]] unsigned long lookup(const Key &key, Hash h) const {
+        for (auto i = home(h);; i = (i + 1) & mask()) {
+            auto v = get(i);
+            if (v == EMPTY)
+                return slots();
+            if (v != DUMMY) {
+                auto &entry = entries[v - 2];
+                if (entry.key.hash() == h && entry.key == key)
+                    return i;
+            }
+        }
+    }
+
+    /// 把 entries[pos] 放进第一个空位或墓碑
+    void place(Hash h, unsigned long pos) {
+        auto i = home(h);
+        while (get(i) > DUMMY)
+            i = (i + 1) & mask();
+        if (get(i) == EMPTY)
+            used++;
+        set(i, pos + 2);
+    }
+
+    /// 去掉墓碑，并按当前容量重建索引
+    void rebuild() {
+        if (entries.size() != count) {
+            std::vector<Entry> live;
+            live.reserve(count);
+            auto new_hand = 0ul;
+            for (unsigned long pos = 0; pos < entries.size(); pos++) {
+                if (entries[pos].value == nullptr)
+                    continue;
+                if (pos < hand)
+                    new_hand++;
+                live.push_back(std::move(entries[pos]));
+            }
+            entries.swap(live);
+            hand = new_hand;
+        }
+
+        // a cache keeps room for as many DUMMY slots as entries, so it rebuilds once per `bound` evictions
+        auto target = bound ? 2 * bound : std::max(capacity, count);
+        auto index_log2 = MIN_INDEX_LOG2;
+        while ((1ul << index_log2) * 2 / 3 < target)
+            index_log2++;
+        shift = 64 - index_log2;
+        width = usable() + 2 <= UINT8_MAX ? 1 : usable() + 2 <= UINT16_MAX ? 2 : usable() + 2 <= UINT32_MAX ? 4 : 8;
+
+        index.assign(slots() * width, 0);
+        used = 0;
+        for (unsigned long pos = 0; pos < entries.size(); pos++)
+            place(entries[pos].key.hash(), pos);
+    }
+
+    /// 把 entries[pos] 变为墓碑
+    void remove(unsigned long i, unsigned long pos) {
+        entries[pos].value = nullptr;
+        set(i, DUMMY);
+        count--;
+    }
+
+    /// CLOCK：指针经过最近被访问过的 entry 时清除标记，淘汰遇到的第一个没有标记的 entry，返回它的位置
+    unsigned long evict() {
+        for (;; hand++) {
+            if (hand >= entries.size())
+                hand = 0;
+            if (entries[hand].value == nullptr)
+                continue;
+            if (!entries[hand].referenced)
+                break;
+            entries[hand].referenced = false;
+        }
+
+        auto i = home(entries[hand].key.hash());
+        while (get(i) != hand + 2)
+            i = (i + 1) & mask();
+        remove(i, hand);
+        return hand++;
+    }
+
+public:
+    explicit CompactHashPart(unsigned long hash_size_log2):
+        width(1), shift(64 - MIN_INDEX_LOG2), used(0), count(0), capacity(1ul << hash_size_log2), bound(0), hand(0) {
+        rebuild();
+    }
+
+    std::shared_ptr<Value>* find(const Key &key) override {
+        auto i = lookup(key, key.hash());
+        if (i == slots())
+            return nullptr;
+        auto &entry = entries[get(i) - 2];
+        if (bound)
+            entry.referenced = true;
+        return &entry.value;
+    }
+
+    bool insert(const Key &key, const std::shared_ptr<Value> &value) override {
+        auto h = key.hash();
+        auto i = lookup(key, h);
+        if (i != slots()) {
+            auto &entry = entries[get(i) - 2];
+            entry.value = value;
+            if (bound)
+                entry.referenced = true;
+            return true;
+        }
+        unsigned long pos;
+        if (count >= capacity) {
+            if (!bound)
+                return false;
+            // reuse the victim's entry, so that a full cache never leaves tombstones behind
+            pos = evict();
+            entries[pos].~Entry();
+            new (&entries[pos]) Entry{ key, value, false };
+        } else {
+            if (entries.size() >= usable())
+                rebuild();
+            pos = entries.size();
+            entries.push_back({ key, value, false });
+        }
+        count++;
+
+        // evicting turns index slots into DUMMY, clean them up before the probes get long
+        if (used >= usable())
+            rebuild();
+        else
+            place(h, pos);
+        return true;
+    }
+
+    void erase(const Key &key) override {
+        auto i = lookup(key, key.hash());
+        if (i == slots())
+            return;
+        remove(i, get(i) - 2);
+        if (2 * count < entries.size())
+            rebuild();
+    }
+
+    [[nodiscard]] unsigned long size() const override {
+        return count;
+    }
+
+    void for_each_int(const std::function<void(Integer)> &f) override {
+        for (auto &entry: entries)
+            if (entry.value != nullptr && entry.key.type() == INT)
+                f(entry.key.item());
+    }
+
+    void extract_ints(Integer base, unsigned long size, const std::function<void(Integer, std::shared_ptr<Value>&&)> &f) override {
+        auto before = count;
+        for (auto &entry: entries)
+            if (entry.value != nullptr && entry.key.type() == INT &&
+                (unsigned long)entry.key.item() - (unsigned long)base < size) {
+                f(entry.key.item(), std::move(entry.value));
+                entry.value = nullptr;
+                count--;
+            }
+        if (count != before)
+            rebuild();
+    }
+
+    void resize(unsigned long hash_size_log2) override {
+        capacity = bound ? bound : 1ul << hash_size_log2;
+        rebuild();
+    }
+
+    /// 最多保留 n 个 entry，插入新 key 时淘汰旧的 entry 而不是扩容，n 为 0 时取消限制
+    void set_bound(unsigned long n) {
+        if (n && !bound)
+            for (auto &entry: entries)
+                entry.referenced = false;
+        bound = n;
+        if (!bound)
+            return;
+        while (count > bound)
+            evict();
+        capacity = bound;
+        rebuild();
+    }
+
+    [[nodiscard]] unsigned long slot_count() const override {
+        return entries.size();
+    }
+
+    /// 按插入顺序访问 entry。缓存中新 entry 占用被淘汰者的位置，不再保持插入顺序
+    void for_each_in(unsigned long begin, unsigned long end, const std::function<void(const Key&, std::shared_ptr<Value>&)> &f) override {
+        for (auto pos = begin; pos < end; pos++)
+            if (entries[pos].value != nullptr)
+                f(entries[pos].key, entries[pos].value);
+    }
+};
+
+#endif //TABLE_COMPACTHASHPART_H
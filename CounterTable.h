@@ -0,0 +1,232 @@
+#ifndef TABLE_COUNTERTABLE_H
+#define TABLE_COUNTERTABLE_H
+
+#include "HashWrapper.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+/// 多线程计数用的表，value 是 64 位整数，保存在原子变量里。
+/// 已有 key 的增减是无锁的 fetch_add；新 key 按 hash 分到 64 个分片之一，只锁住这个分片。
+/// 分片满了以后在锁内搬到两倍大的数组：旧 slot 的计数被原子地换成 FROZEN，
+/// 之后落到旧 slot 上的 fetch_add 会看到 FROZEN，等搬迁结束后在新数组上重做，所以不会丢失。
+/// 计数的绝对值需要小于 2^61，不支持删除 key
+class CounterTable {
+private:
+    struct Slot {
+        std::atomic<Key*> key{ nullptr }; // published last, nullptr iff the slot is free
+        std::atomic<Hash> hash{ 0 };
+        std::atomic<int64_t> count{ 0 };
+    };
+
+    struct Level {
+        unsigned size_log2;
+        std::unique_ptr<Slot[]> slots;
+        unsigned long used; // guarded by the shard lock
+
+        explicit Level(unsigned size_log2): size_log2(size_log2), slots(new Slot[1ul << size_log2]), used(0) {}
+    };
+
+    static const unsigned SHARD_BITS = 6;
+    static const unsigned SHARDS = 1u << SHARD_BITS;
+    static const unsigned MIN_LEVEL_LOG2 = 3;
+
+    // the count of a slot that has been moved, increments that land on it afterwards are redone
+    static const int64_t FROZEN = INT64_MIN / 2;
+
+    static bool frozen(int64_t count) {
+        return count < FROZEN / 2;
+    }
+
+    // one cache line per shard header, so that locking one shard doesn't slow down its neighbours
+    struct alignas(64) Shard {
+        std::mutex lock;
+        std::atomic<Level*> current{ nullptr };
+        // Every level the shard has used, guarded by the lock. Readers may still be probing an old
+        // level, so they are only freed with the table; together they are smaller than the current one.
+        std::vector<std::unique_ptr<Level>> levels;
+        std::atomic<unsigned long> count{ 0 };
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    unsigned first_level_log2;
+
+    static Hash mix(Hash h) {
+        return h * 0x9E3779B97F4A7C15ull;
+    }
+
+    Shard& shard_of(Hash h) const {
+        return shards[mix(h) >> (64 - SHARD_BITS)];
+    }
+
+    /// 去掉选分片用掉的高位，剩下的高位选 slot
+    static unsigned long position(Hash h, const Level* level) {
+        return (mix(h) << SHARD_BITS) >> (64 - level->size_log2);
+    }
+
+    /// 无锁查找，和插入并发时可能找不到刚插入的 key，调用者需要加锁再找一次
+    static Slot* find(Level* level, const Key &key, Hash h) {
+        if (level == nullptr)
+            return nullptr;
+        auto mask = (1ul << level->size_log2) - 1;
+        for (auto j = position(h, level);; j = (j + 1) & mask) {
+            auto &slot = level->slots[j];
+            auto stored = slot.key.load(std::memory_order_acquire);
+            if (stored == nullptr)
+                return nullptr;
+            if (slot.hash.load(std::memory_order_relaxed) == h && *stored == key)
+                return &slot;
+        }
+    }
+
+    /// 在 level 中找一个空 slot 放入 key，需要持有分片的锁
+    static void place(Level* level, Key* key, Hash h, int64_t count) {
+        auto mask = (1ul << level->size_log2) - 1;
+        auto j = position(h, level);
+        while (level->slots[j].key.load(std::memory_order_relaxed) != nullptr)
+            j = (j + 1) & mask;
+
+        auto &slot = level->slots[j];
+        slot.hash.store(h, std::memory_order_relaxed);
+        slot.count.store(count, std::memory_order_relaxed);
+        slot.key.store(key, std::memory_order_release);
+        level->used++;
+    }
+
+    /// 把分片搬到两倍大的数组，需要持有分片的锁
+    Level* grow(Shard &shard) {
+        auto old = shard.current.load(std::memory_order_relaxed);
+        auto level = new Level(old ? old->size_log2 + 1 : first_level_log2);
+        shard.levels.emplace_back(level);
+
+        if (old != nullptr)
+            for (unsigned long j = 0; j < (1ul << old->size_log2); j++) {
+                auto &slot = old->slots[j];
+                auto key = slot.key.load(std::memory_order_relaxed);
+                if (key != nullptr)
+                    place(level, key, slot.hash.load(std::memory_order_relaxed),
+                          slot.count.exchange(FROZEN, std::memory_order_acq_rel));
+            }
+
+        shard.current.store(level, std::memory_order_release);
+        return level;
+    }
+
+public:
+    class CounterReference {
+    private:
+        Key key;
+        CounterTable* table;
+
+    public:
+        CounterReference(const Key &key, CounterTable* table): key(key), table(table) {}
+
+        CounterReference& operator += (int64_t delta) {
+            table->add(key, delta);
+            return *this;
+        }
+
+        CounterReference& operator -= (int64_t delta) {
+            table->add(key, -delta);
+            return *this;
+        }
+
+        CounterReference& operator ++ () {
+            table->add(key, 1);
+            return *this;
+        }
+
+        operator int64_t () const {
+            return table->get(key);
+        }
+    };
+
+    /// 预计共有 2^hash_size_log2 个 key
+    explicit CounterTable(unsigned long hash_size_log2 = 10):
+        shards(new Shard[SHARDS]),
+        // each shard gets its share of the keys at a load of 1/2
+        first_level_log2(hash_size_log2 + 1 > SHARD_BITS + MIN_LEVEL_LOG2 ? hash_size_log2 + 1 - SHARD_BITS : MIN_LEVEL_LOG2) {}
+
+    CounterTable(const CounterTable&) = delete;
+    CounterTable& operator = (const CounterTable&) = delete;
+
+    ~CounterTable() {
+        for (unsigned s = 0; s < SHARDS; s++) {
+            auto level = shards[s].current.load();
+            if (level != nullptr)
+                for (unsigned long j = 0; j < (1ul << level->size_log2); j++)
+                    delete level->slots[j].key.load();
+        }
+    }
+
+    /// 给 key 的计数加上 delta，返回加之后的值。不存在的 key 从 0 开始计数
+    int64_t add(const Key &key, int64_t delta = 1) {
+        auto h = key.hash();
+        auto &shard = shard_of(h);
+
+        if (auto slot = find(shard.current.load(std::memory_order_acquire), key, h)) {
+            auto old = slot->count.fetch_add(delta, std::memory_order_relaxed);
+            if (!frozen(old))
+                return old + delta;
+            // the slot is being moved, redo the increment below once the new level is published
+        }
+
+        // the level can't change while we hold the lock, so nothing found here is frozen
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto level = shard.current.load(std::memory_order_relaxed);
+        if (auto slot = find(level, key, h))
+            return slot->count.fetch_add(delta, std::memory_order_relaxed) + delta;
+
+        if (level == nullptr || 2 * (level->used + 1) > (1ul << level->size_log2))
+            level = grow(shard);
+        place(level, new Key(key), h, delta);
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        return delta;
+    }
+
+    /// key 的当前计数，不存在时为 0
+    int64_t get(const Key &key) const {
+        auto h = key.hash();
+        auto &shard = shard_of(h);
+
+        if (auto slot = find(shard.current.load(std::memory_order_acquire), key, h)) {
+            auto count = slot->count.load(std::memory_order_relaxed);
+            if (!frozen(count))
+                return count;
+        }
+
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto slot = find(shard.current.load(std::memory_order_relaxed), key, h);
+        return slot ? slot->count.load(std::memory_order_relaxed) : 0;
+    }
+
+    [[nodiscard]] unsigned long size() const {
+        unsigned long n = 0;
+        for (unsigned s = 0; s < SHARDS; s++)
+            n += shards[s].count.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    /// 访问每个 key 与它的计数，f 的参数为 (const Key&, int64_t)，访问期间依次锁住每个分片
+    template<class F>
+    void for_each(F f) const {
+        for (unsigned s = 0; s < SHARDS; s++) {
+            std::lock_guard<std::mutex> guard(shards[s].lock);
+            auto level = shards[s].current.load(std::memory_order_relaxed);
+            if (level == nullptr)
+                continue;
+            for (unsigned long j = 0; j < (1ul << level->size_log2); j++) {
+                auto key = level->slots[j].key.load(std::memory_order_relaxed);
+                if (key != nullptr)
+                    f(*key, level->slots[j].count.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    CounterReference operator [] (const Key &key) {
+        return { key, this };
+    }
+};
+
+#endif //TABLE_COUNTERTABLE_H
@@ -0,0 +1,322 @@
+#ifndef TABLE_EXTENDIBLEHASHPART_H
+#define TABLE_EXTENDIBLEHASHPART_H
+
+#include "HashPart.h"
+#include <algorithm>
+
+/// 可扩展 hash (extendible hashing)：目录的每一项指向一个固定大小的段，段内线性探测。
+/// 每个段有自己的局部深度，段满时只把它自己的 entry 分到两个新段中，目录最多翻倍一次且只复制指针，
+/// 不会整体 rehash。查找是一次目录访问加一次段内探测。段不合并，删除后的空间留给之后的插入。
+/// 分裂分不开的 key（hash 相同，或目录已经过大）放进段的溢出链，与链式 hash 一样逐个比较
+class ExtendibleHashPart: public IHashPart {
+private:
+    static const unsigned SEGMENT_LOG2 = 9;
+    static const unsigned long SEGMENT = 1ul << SEGMENT_LOG2;
+    static const unsigned long MAX_FILL = SEGMENT * 3 / 4; // a segment this full splits
+    static const unsigned long MAX_SPREAD = 64; // directory entries per segment, beyond it hashes are skewed
+
+    // INT keys are stored inline, any other key is copied to the heap.
+    struct Slot {
+        Hash mixed; // the scrambled hash, the top bits choose the segment
+        Integer i;
+        Key* other; // nullptr for an INT key
+        std::shared_ptr<Value> value; // nullptr iff the slot is free
+    };
+
+    struct Segment {
+        unsigned depth; // the top `depth` bits of mixed are the same for every key in the segment
+        unsigned long id; // position in segments
+        unsigned long count; // entries in slots, the overflow chain not included
+        Slot slots[SEGMENT];
+        std::vector<Slot> overflow; // entries that came while the segment was full and could not split
+    };
+
+    std::vector<Segment*> directory; // 2^depth entries, indexed by the top bits of mixed
+    unsigned depth;
+    std::vector<std::unique_ptr<Segment>> segments; // owns the segments, in the order for_each_in visits them
+    unsigned long count;
+    unsigned long capacity;
+
+    /// murmur3 的 fmix64，每一位都依赖 hash 的每一位。只乘一个常数时，针对 Fibonacci hashing 构造的
+    /// key 高位全部相同，目录会一直翻倍
+    static Hash mix(Hash h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+    /// 段内的起始位置用低位，目录用不到这么深
+    static unsigned long home(Hash mixed) {
+        return mixed & (SEGMENT - 1);
+    }
+
+    [[nodiscard]] Segment* segment_of(Hash mixed) const {
+        // two shifts, so that depth 0 needs no branch
+        return directory[(mixed >> 1) >> (63 - depth)];
+    }
+
+    static bool equals(const Slot &slot, Hash mixed, const Key &key) {
+        if (slot.mixed != mixed)
+            return false;
+        return slot.other == nullptr ? key.type() == INT && slot.i == key.item() : key.type() != INT && *slot.other == key;
+    }
+
+    static Key key_of(const Slot &slot) {
+        return slot.other == nullptr ? Key(slot.i) : *slot.other;
+    }
+
+    /// 空出 slot。entry 被移走后 other 仍是原来的指针，必须清掉
+    static void vacate(Slot &slot) {
+        slot.other = nullptr;
+        slot.value = nullptr;
+    }
+
+    static void release(Slot &slot) {
+        delete slot.other;
+        vacate(slot);
+    }
+
+    /// 返回 key 在段中的位置，不存在时返回 SEGMENT
+    static unsigned long locate(const Segment &segment, Hash mixed, const Key &key) {
+        for (auto i = home(mixed); segment.slots[i].value != nullptr; i = (i + 1) & (SEGMENT - 1))
+            if (equals(segment.slots[i], mixed, key))
+                return i;
+        return SEGMENT;
+    }
+
+    static void place(Segment &segment, Slot &&slot) {
+        auto i = home(slot.mixed);
+        while (segment.slots[i].value != nullptr)
+            i = (i + 1) & (SEGMENT - 1);
+        segment.slots[i] = std::move(slot);
+        segment.count++;
+    }
+
+    /// 放进段中，段满时放进溢出链
+    static void store(Segment &segment, Slot &&slot) {
+        if (segment.count < MAX_FILL)
+            place(segment, std::move(slot));
+        else
+            segment.overflow.push_back(std::move(slot));
+    }
+
+    /// 返回 key 在溢出链中的下标，不存在时返回溢出链的长度
+    static unsigned long locate_overflow(const Segment &segment, Hash mixed, const Key &key) {
+        unsigned long i = 0;
+        while (i < segment.overflow.size() && !equals(segment.overflow[i], mixed, key))
+            i++;
+        return i;
+    }
+
+    /// mixed 所在的满段能否分裂：目录不能过大，并且段中的 key 不能与新 key 的 hash 全部相同，否则分裂分不开它们
+    [[nodiscard]] bool splittable(const Segment &segment, Hash mixed) const {
+        if (segment.depth == depth && directory.size() >= MAX_SPREAD * segments.size())
+            return false;
+        return std::any_of(std::begin(segment.slots), std::end(segment.slots), [&](const Slot &slot) {
+            return slot.value != nullptr && slot.mixed != mixed;
+        });
+    }
+
+    /// 把 mixed 所在的段按第 depth + 1 个高位分到两个新段中，目录里指向它的项前一半指向 low，后一半指向 high
+    void split(Segment* segment, Hash mixed) {
+        if (segment->depth == depth) {
+            // only pointers are copied
+            std::vector<Segment*> doubled(directory.size() * 2);
+            for (unsigned long i = 0; i < doubled.size(); i++)
+                doubled[i] = directory[i >> 1];
+            directory.swap(doubled);
+            depth++;
+        }
+
+        auto low = std::make_unique<Segment>(), high = std::make_unique<Segment>();
+        low->depth = high->depth = segment->depth + 1;
+        low->id = segment->id, high->id = segments.size();
+        low->count = high->count = 0;
+
+        auto bit = 63 - segment->depth;
+        for (auto &slot: segment->slots)
+            if (slot.value != nullptr)
+                place((slot.mixed >> bit) & 1 ? *high : *low, std::move(slot));
+        for (auto &slot: segment->overflow)
+            store((slot.mixed >> bit) & 1 ? *high : *low, std::move(slot));
+
+        // the segment owns a run of 2^(depth - segment depth) directory entries
+        auto run = 1ul << (depth - segment->depth);
+        auto first = ((mixed >> 1) >> (63 - depth)) & ~(run - 1);
+        for (auto i = first; i < first + run; i++)
+            directory[i] = i < first + run / 2 ? low.get() : high.get();
+
+        segments[low->id] = std::move(low); // frees the old segment
+        segments.push_back(std::move(high));
+    }
+
+    /// 删除段中满足 pred 的 entry 后重新放置剩下的 entry，去掉探测序列中的空洞
+    template<class F>
+    void remove_if(Segment &segment, F pred) {
+        std::vector<Slot> kept;
+        auto take = [&](Slot &slot) {
+            if (slot.value == nullptr)
+                return;
+            if (pred(slot)) {
+                release(slot);
+                count--;
+            } else {
+                kept.push_back(std::move(slot));
+                vacate(slot);
+            }
+        };
+        for (auto &slot: segment.slots)
+            take(slot);
+        for (auto &slot: segment.overflow)
+            take(slot);
+        segment.count = 0;
+        segment.overflow.clear();
+        for (auto &slot: kept)
+            store(segment, std::move(slot));
+    }
+
+public:
+    explicit ExtendibleHashPart(unsigned long hash_size_log2):
+        depth(0), count(0), capacity(1ul << hash_size_log2) {
+        segments.push_back(std::make_unique<Segment>());
+        auto &segment = *segments.back();
+        segment.depth = 0, segment.id = 0, segment.count = 0;
+        directory.push_back(&segment);
+    }
+
+    ExtendibleHashPart(const ExtendibleHashPart&) = delete;
+    ExtendibleHashPart& operator = (const ExtendibleHashPart&) = delete;
+
+    ~ExtendibleHashPart() override {
+        for (auto &segment: segments) {
+            for (auto &slot: segment->slots)
+                delete slot.other;
+            for (auto &slot: segment->overflow)
+                delete slot.other;
+        }
+    }
+
+    std::shared_ptr<Value>* find(const Key &key) override {
+        auto mixed = mix(key.hash());
+        auto &segment = *segment_of(mixed);
+        auto i = locate(segment, mixed, key);
+        if (i != SEGMENT)
+            return &segment.slots[i].value;
+        if (segment.overflow.empty())
+            return nullptr;
+        auto j = locate_overflow(segment, mixed, key);
+        return j == segment.overflow.size() ? nullptr : &segment.overflow[j].value;
+    }
+
+    bool insert(const Key &key, const std::shared_ptr<Value> &value) override {
+        auto mixed = mix(key.hash());
+        auto segment = segment_of(mixed);
+        auto slot = find(key);
+        if (slot != nullptr) {
+            *slot = value;
+            return true;
+        }
+        if (count >= capacity)
+            return false;
+
+        // Splitting a segment at the global depth doubles the directory. When the directory already
+        // outnumbers the segments by far, or no split can separate the keys, the entry overflows.
+        while (segment->count >= MAX_FILL && splittable(*segment, mixed)) {
+            split(segment, mixed);
+            segment = segment_of(mixed);
+        }
+        store(*segment, { mixed, key.type() == INT ? key.item() : 0, key.type() == INT ? nullptr : new Key(key), value });
+        count++;
+        return true;
+    }
+
+    void erase(const Key &key) override {
+        auto mixed = mix(key.hash());
+        auto &segment = *segment_of(mixed);
+        auto i = locate(segment, mixed, key);
+        if (i == SEGMENT) {
+            auto j = locate_overflow(segment, mixed, key);
+            if (j == segment.overflow.size())
+                return;
+            release(segment.overflow[j]);
+            segment.overflow[j] = std::move(segment.overflow.back());
+            segment.overflow.pop_back();
+            count--;
+            return;
+        }
+
+        release(segment.slots[i]);
+        segment.count--;
+        count--;
+
+        // backward shift inside the segment, as in ProbingPart
+        const auto mask = SEGMENT - 1;
+        for (auto j = (i + 1) & mask; segment.slots[j].value != nullptr; j = (j + 1) & mask) {
+            auto k = home(segment.slots[j].mixed);
+            if (((j - k) & mask) >= ((j - i) & mask)) {
+                segment.slots[i] = std::move(segment.slots[j]);
+                vacate(segment.slots[j]);
+                i = j;
+            }
+        }
+    }
+
+    [[nodiscard]] unsigned long size() const override {
+        return count;
+    }
+
+    [[nodiscard]] unsigned long slot_count() const override {
+        return segments.size() * SEGMENT;
+    }
+
+    /// 段按创建顺序排开，每段 SEGMENT 个位置，溢出链算在段的最后一个位置上
+    void for_each_in(unsigned long begin, unsigned long end, const std::function<void(const Key&, std::shared_ptr<Value>&)> &f) override {
+        for (auto pos = begin; pos < end; pos++) {
+            auto &segment = *segments[pos >> SEGMENT_LOG2];
+            auto &slot = segment.slots[pos & (SEGMENT - 1)];
+            if (slot.value != nullptr)
+                f(key_of(slot), slot.value);
+            if ((pos & (SEGMENT - 1)) == SEGMENT - 1)
+                for (auto &entry: segment.overflow)
+                    f(key_of(entry), entry.value);
+        }
+    }
+
+    void for_each_int(const std::function<void(Integer)> &f) override {
+        for (auto &segment: segments) {
+            for (auto &slot: segment->slots)
+                if (slot.value != nullptr && slot.other == nullptr)
+                    f(slot.i);
+            for (auto &slot: segment->overflow)
+                if (slot.other == nullptr)
+                    f(slot.i);
+        }
+    }
+
+    void extract_ints(Integer base, unsigned long size, const std::function<void(Integer, std::shared_ptr<Value>&&)> &f) override {
+        auto in_range = [&](const Slot &slot) {
+            return slot.value != nullptr && slot.other == nullptr && (unsigned long)slot.i - (unsigned long)base < size;
+        };
+        for (auto &segment: segments) {
+            // only segments that lose entries are rebuilt
+            if (std::none_of(std::begin(segment->slots), std::end(segment->slots), in_range) &&
+                std::none_of(segment->overflow.begin(), segment->overflow.end(), in_range))
+                continue;
+            remove_if(*segment, [&](Slot &slot) {
+                if (!in_range(slot))
+                    return false;
+                f(slot.i, std::move(slot.value));
+                return true;
+            });
+        }
+    }
+
+    /// 段满时各自分裂，这里只调整容量上限
+    void resize(unsigned long hash_size_log2) override {
+        capacity = 1ul << hash_size_log2;
+    }
+};
+
+#endif //TABLE_EXTENDIBLEHASHPART_H
@@ -0,0 +1,228 @@
+#ifndef TABLE_FIXEDTABLE_H
+#define TABLE_FIXEDTABLE_H
+
+#include "HashWrapper.h"
+#include <array>
+#include <string_view>
+#include <cstdint>
+
+/// FixedTable 的 key，只能是整数或字符串，与内容相同的 Key 等价：FixedKey(1) 对应 Key(1)，
+/// FixedKey("add") 对应 Key("add")，hash 也相同
+class FixedKey {
+private:
+    Tag tag;
+    Integer i;
+    std::string_view s; // the characters must outlive the table, string literals do
+
+public:
+    constexpr FixedKey(): tag(INT), i(0), s() {}
+
+    template<class T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    constexpr FixedKey(T value): tag(INT), i((Integer)value), s() {}
+
+    constexpr FixedKey(const char* value): tag(STR), i(0), s(value) {}
+
+    constexpr FixedKey(std::string_view value): tag(STR), i(0), s(value) {}
+
+    [[nodiscard]] constexpr Tag type() const { return tag; }
+
+    [[nodiscard]] constexpr Integer item() const { return i; }
+
+    [[nodiscard]] constexpr std::string_view str() const { return s; }
+
+    [[nodiscard]] constexpr Hash hash() const {
+        return tag == INT ? Key::hash_INT(i) : Key::hash_STR(s);
+    }
+
+    constexpr bool operator == (const FixedKey &other) const {
+        return tag == other.tag && (tag == INT ? i == other.i : s == other.s);
+    }
+};
+
+/// 编译期建好的只读表，N 个 entry，value 的类型为 V，V 需要可以在编译期默认构造与复制。
+/// 仿照 CHD 构造完美 hash：key 先按 hash 分到 N / 4 个桶中，从大桶开始，为每个桶找一个位移 d，
+/// 使桶中的 key 都落在不同的空位上。查找只需计算一次 hash、读一次位移、比较一次 key：
+///
+///     constexpr FixedTable<const char*, 3> OPCODES({ { 0x01, "add" }, { 0x02, "sub" }, { "nop", "" } });
+///     static_assert(OPCODES.contains(0x02));
+///
+/// 找不到完美 hash 或者 key 重复时编译失败
+template<class V, size_t N>
+class FixedTable {
+public:
+    /// std::pair 的赋值在 C++17 中不是 constexpr，不能在 constexpr 函数里逐个填写，所以自己定义
+    struct Entry {
+        FixedKey first;
+        V second;
+    };
+
+private:
+    static constexpr size_t ceil2(size_t x) {
+        size_t p = 1;
+        while (p < x)
+            p <<= 1;
+        return p;
+    }
+
+    static constexpr size_t SLOTS = ceil2(N);
+    static constexpr size_t BUCKETS = ceil2((N + 3) / 4);
+    static constexpr Hash MAX_SALT = 64; // whole-table retries with a different mix
+    static constexpr uint32_t MAX_DISPLACEMENT = 1u << 16;
+
+    struct Slot {
+        FixedKey key;
+        V value;
+        bool used;
+
+        constexpr Slot(): key(), value(), used(false) {}
+    };
+
+    std::array<Slot, SLOTS> slots;
+    std::array<uint32_t, BUCKETS> displacement;
+    Hash salt;
+
+    /// murmur3 的 finalizer，让每一位都依赖 hash 的所有位
+    static constexpr Hash mix(Hash h, Hash salt) {
+        h ^= salt;
+        h ^= h >> 33, h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33, h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+    static constexpr size_t bucket(Hash m) {
+        return m & (BUCKETS - 1);
+    }
+
+    /// 位移 d 相当于换一个 hash 函数，不同的 d 给出互不相关的位置
+    static constexpr size_t position(Hash m, uint32_t d) {
+        return (((m ^ (d * 0x9E3779B97F4A7C15ull)) * 0xff51afd7ed558ccdull) >> 32) & (SLOTS - 1);
+    }
+
+    /// 用 salt 尝试构造，失败时返回 false
+    constexpr bool build(const Entry* entries, Hash s) {
+        for (auto &slot: slots)
+            slot = Slot();
+
+        // the keys of bucket b are members[first[b]], ..., members[first[b + 1] - 1]
+        std::array<Hash, N> m{};
+        std::array<size_t, N> members{};
+        std::array<size_t, BUCKETS + 1> first{};
+        for (size_t k = 0; k < N; k++)
+            m[k] = mix(entries[k].first.hash(), s), first[bucket(m[k]) + 1]++;
+        for (size_t b = 0; b < BUCKETS; b++)
+            first[b + 1] += first[b];
+        auto cursor = first;
+        for (size_t k = 0; k < N; k++)
+            members[cursor[bucket(m[k])]++] = k;
+
+        // the largest buckets first, while there is still room
+        auto size = [&](size_t b) { return first[b + 1] - first[b]; };
+        std::array<size_t, BUCKETS> order{};
+        for (size_t b = 0; b < BUCKETS; b++) {
+            size_t j = b;
+            for (; j > 0 && size(order[j - 1]) < size(b); j--)
+                order[j] = order[j - 1];
+            order[j] = b;
+        }
+
+        for (size_t b: order) {
+            // equal keys share a bucket, and no displacement could ever separate them
+            for (auto i = first[b]; i < first[b + 1]; i++)
+                for (auto j = i + 1; j < first[b + 1]; j++)
+                    if (entries[members[i]].first == entries[members[j]].first)
+                        throw std::logic_error("FixedTable: duplicate key");
+
+            bool placed = false;
+            for (uint32_t d = 0; d < MAX_DISPLACEMENT && !placed && size(b) > 0; d++) {
+                auto i = first[b];
+                for (; i < first[b + 1]; i++) {
+                    auto &slot = slots[position(m[members[i]], d)];
+                    if (slot.used)
+                        break;
+                    slot.used = true;
+                }
+                placed = i == first[b + 1];
+                // undo a partial placement, or fill in the entries of a complete one
+                for (auto j = first[b]; j < i; j++) {
+                    auto &slot = slots[position(m[members[j]], d)];
+                    if (placed)
+                        slot.key = entries[members[j]].first, slot.value = entries[members[j]].second;
+                    else
+                        slot.used = false;
+                }
+                if (placed)
+                    displacement[b] = d;
+            }
+            if (!placed && size(b) > 0)
+                return false;
+        }
+        return true;
+    }
+
+    constexpr const V* lookup(const FixedKey &key) const {
+        auto m = mix(key.hash(), salt);
+        auto &slot = slots[position(m, displacement[bucket(m)])];
+        return slot.used && slot.key == key ? &slot.value : nullptr;
+    }
+
+    constexpr void init(const Entry* entries) {
+        for (Hash s = 0; s < MAX_SALT; s++)
+            if (build(entries, s * 0x9E3779B97F4A7C15ull)) {
+                salt = s * 0x9E3779B97F4A7C15ull;
+                return;
+            }
+        throw std::logic_error("FixedTable: no perfect hash found");
+    }
+
+public:
+    static_assert(N > 0, "FixedTable: a table needs at least one entry");
+
+    constexpr explicit FixedTable(const Entry (&entries)[N]): slots(), displacement(), salt(0) {
+        init(entries);
+    }
+
+    /// 由 constexpr 函数生成的 entry，例如先建一个 std::array<Entry, N>，再在循环中逐个赋值
+    constexpr explicit FixedTable(const std::array<Entry, N> &entries): slots(), displacement(), salt(0) {
+        init(entries.data());
+    }
+
+    [[nodiscard]] static constexpr size_t size() {
+        return N;
+    }
+
+    /// key 对应的 value，不存在时返回 nullptr
+    constexpr const V* find(Integer key) const {
+        return lookup(FixedKey(key));
+    }
+
+    constexpr const V* find(std::string_view key) const {
+        return lookup(FixedKey(key));
+    }
+
+    constexpr const V* find(const char* key) const {
+        return lookup(FixedKey(key));
+    }
+
+    const V* find(const std::string &key) const {
+        return lookup(FixedKey(std::string_view(key)));
+    }
+
+    /// 用运行时的 Key 查找，直接使用 Key 缓存的 hash。NUM、PTR 与 H 类型的 key 总是不存在
+    const V* find(const Key &key) const {
+        if (key.type() != INT && key.type() != STR)
+            return nullptr;
+        auto m = mix(key.hash(), salt);
+        auto &slot = slots[position(m, displacement[bucket(m)])];
+        if (!slot.used || slot.key.type() != key.type())
+            return nullptr;
+        auto same = key.type() == INT ? slot.key.item() == key.item() : slot.key.str() == key.str();
+        return same ? &slot.value : nullptr;
+    }
+
+    template<class K>
+    constexpr bool contains(const K &key) const {
+        return find(key) != nullptr;
+    }
+};
+
+#endif //TABLE_FIXEDTABLE_H
@@ -0,0 +1,241 @@
+#ifndef TABLE_HASHPART_H
+#define TABLE_HASHPART_H
+
+#include "HashWrapper.h"
+#include <vector>
+
+using Value = std::any;
+
+/// Table 中 hash 部分的可替换实现，默认的链式 hash 部分直接写在 Table 里
+class IHashPart {
+public:
+    virtual ~IHashPart() = default;
+
+    /// 查找 key，返回存放 value 的位置，不存在时返回 nullptr
+    virtual std::shared_ptr<Value>* find(const Key &key) = 0;
+
+    /// 插入或更新 entry。新 key 超出容量时返回 false 且不插入，此时 Table 需要 resize
+    virtual bool insert(const Key &key, const std::shared_ptr<Value> &value) = 0;
+
+    virtual void erase(const Key &key) = 0;
+
+    [[nodiscard]] virtual unsigned long size() const = 0;
+
+    /// 遍历用的位置个数。[0, slot_count()) 可以切成若干段分别遍历，每个 entry 恰好落在一个位置上
+    [[nodiscard]] virtual unsigned long slot_count() const = 0;
+
+    /// 依次访问位置落在 [begin, end) 中的 entry
+    virtual void for_each_in(unsigned long begin, unsigned long end, const std::function<void(const Key&, std::shared_ptr<Value>&)> &f) = 0;
+
+    /// 依次访问每个 entry
+    void for_each(const std::function<void(const Key&, std::shared_ptr<Value>&)> &f) {
+        for_each_in(0, slot_count(), f);
+    }
+
+    /// 依次访问每个 INT key，用于计算 array 部分的大小
+    virtual void for_each_int(const std::function<void(Integer)> &f) = 0;
+
+    /// 取出所有落在 [base, base + size) 中的 INT key，它们将移入 array 部分
+    virtual void extract_ints(Integer base, unsigned long size, const std::function<void(Integer, std::shared_ptr<Value>&&)> &f) = 0;
+
+    /// 容量调整为 2^hash_size_log2 个 entry
+    virtual void resize(unsigned long hash_size_log2) = 0;
+};
+
+/// 整数 key，原样保存
+struct IntTraits {
+    using Stored = Integer;
+
+    static Stored make(const Key &key, Hash) { return key.item(); }
+    static Key key(const Stored &s) { return s; }
+    static Hash hash(const Stored &s) { return Key(s).hash(); }
+    static bool equals(const Stored &s, Hash, const Key &key) { return s == key.item(); }
+    static void release(Stored&) {}
+};
+
+/// 指针 key，原样保存
+struct PtrTraits {
+    using Stored = void*;
+
+    static Stored make(const Key &key, Hash) { return key.pointer(); }
+    static Key key(const Stored &s) { return s; }
+    static Hash hash(const Stored &s) { return Key(s).hash(); }
+    static bool equals(const Stored &s, Hash, const Key &key) { return s == key.pointer(); }
+    static void release(Stored&) {}
+};
+
+/// 字符串 key，每个 slot 持有自己的一份字符串，slot 里是它的指针与 hash。
+/// 字符串没有驻留 (intern)：完整的 hash 相同时才比较内容
+struct StrTraits {
+    struct Stored {
+        Hash hash;
+        std::string* str;
+    };
+
+    static Stored make(const Key &key, Hash h) { return { h, new std::string(key.str()) }; }
+    static Key key(const Stored &s) { return *s.str; }
+    static Hash hash(const Stored &s) { return s.hash; }
+    static bool equals(const Stored &s, Hash h, const Key &key) { return s.hash == h && *s.str == key.str(); }
+    static void release(Stored &s) { delete s.str; }
+};
+
+/// 其余的 key (NUM, H)，保存一份带 hash 缓存的 Key
+struct GenericTraits {
+    using Stored = Key*;
+
+    static Stored make(const Key &key, Hash) { return new Key(key); }
+    static const Key& key(const Stored &s) { return *s; }
+    static Hash hash(const Stored &s) { return s->hash(); }
+    static bool equals(const Stored &s, Hash h, const Key &key) { return s->hash() == h && *s == key; }
+    static void release(Stored &s) { delete s; }
+};
+
+/// 线性探测的开放寻址表，负载不超过 1/2，删除时向前移动后继元素而不留墓碑
+template<class Traits>
+class ProbingPart {
+public:
+    using KeyTraits = Traits;
+    using Stored = typename Traits::Stored;
+
+    struct Slot {
+        Stored key;
+        std::shared_ptr<Value> value; // nullptr iff the slot is free
+    };
+
+private:
+    std::vector<Slot> slots;
+    unsigned long count;
+    unsigned shift; // 64 - log2(slots.size())
+
+    static const unsigned MIN_SIZE_LOG2 = 3;
+
+    /// Fibonacci hashing, so that strided integer keys don't end up in one cluster.
+    [[nodiscard]] unsigned long index(Hash h) const {
+        return (h * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+
+    [[nodiscard]] unsigned long mask() const {
+        return slots.size() - 1;
+    }
+
+    void place(Slot &&slot) {
+        auto i = index(Traits::hash(slot.key));
+        while (slots[i].value != nullptr)
+            i = (i + 1) & mask();
+        slots[i] = std::move(slot);
+    }
+
+    void rehash(unsigned size_log2) {
+        std::vector<Slot> old(1ul << size_log2);
+        old.swap(slots);
+        shift = 64 - size_log2;
+        for (auto &slot: old)
+            if (slot.value != nullptr)
+                place(std::move(slot));
+    }
+
+    /// 能容纳 n 个元素的最小 size
+    static unsigned fit(unsigned long n) {
+        unsigned size_log2 = MIN_SIZE_LOG2;
+        while ((1ul << size_log2) < 2 * n)
+            size_log2++;
+        return size_log2;
+    }
+
+public:
+    ProbingPart(): slots(1ul << MIN_SIZE_LOG2), count(0), shift(64 - MIN_SIZE_LOG2) {}
+
+    ProbingPart(const ProbingPart&) = delete;
+    ProbingPart& operator = (const ProbingPart&) = delete;
+
+    ~ProbingPart() {
+        for (auto &slot: slots)
+            if (slot.value != nullptr)
+                Traits::release(slot.key);
+    }
+
+    [[nodiscard]] unsigned long size() const {
+        return count;
+    }
+
+    [[nodiscard]] unsigned long capacity() const {
+        return slots.size();
+    }
+
+    /// 返回 key 所在的 slot 下标，不存在时返回 slots.size()
+    [[nodiscard]] unsigned long locate(const Key &key, Hash h) const {
+        for (auto i = index(h); slots[i].value != nullptr; i = (i + 1) & mask())
+            if (Traits::equals(slots[i].key, h, key))
+                return i;
+        return slots.size();
+    }
+
+    std::shared_ptr<Value>* find(const Key &key, Hash h) {
+        auto i = locate(key, h);
+        return i == slots.size() ? nullptr : &slots[i].value;
+    }
+
+    /// 插入一个不在表中的 key
+    void insert(const Key &key, Hash h, const std::shared_ptr<Value> &value) {
+        if (2 * (count + 1) > slots.size())
+            rehash(fit(count + 1));
+        place({ Traits::make(key, h), value });
+        count++;
+    }
+
+    void erase(const Key &key, Hash h) {
+        auto i = locate(key, h);
+        if (i == slots.size())
+            return;
+
+        Traits::release(slots[i].key);
+
+        // backward shift: move later elements of the cluster into the hole when that doesn't
+        // put them in front of their home slot
+        for (auto j = (i + 1) & mask(); slots[j].value != nullptr; j = (j + 1) & mask()) {
+            auto k = index(Traits::hash(slots[j].key));
+            if (((j - k) & mask()) >= ((j - i) & mask())) {
+                slots[i] = std::move(slots[j]);
+                i = j;
+            }
+        }
+        slots[i].value = nullptr;
+        count--;
+    }
+
+    /// 依次访问每个元素，f 返回 true 时删除该元素
+    template<class F>
+    void remove_if(F f) {
+        auto removed = count;
+        for (unsigned long i = 0; i < slots.size(); i++)
+            if (slots[i].value != nullptr && f(slots[i])) {
+                Traits::release(slots[i].key);
+                slots[i].value = nullptr;
+                count--;
+            }
+        // removing in place leaves holes in the clusters, rebuild them
+        if (removed != count)
+            rehash(fit(count));
+    }
+
+    template<class F>
+    void for_each(F f) {
+        for_each(0, slots.size(), f);
+    }
+
+    /// 访问下标在 [begin, end) 中的元素
+    template<class F>
+    void for_each(unsigned long begin, unsigned long end, F f) {
+        for (auto i = begin; i < end; i++)
+            if (slots[i].value != nullptr)
+                f(slots[i]);
+    }
+
+    /// 容量收缩到刚好容纳现有元素
+    void shrink() {
+        if (fit(count) < 64 - shift)
+            rehash(fit(count));
+    }
+};
+
+#endif //TABLE_HASHPART_H
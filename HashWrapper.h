@@ -9,10 +9,14 @@
 #include <cmath>
 #include <climits>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <memory>
 #include <typeindex>
 #include <any>
+#include <unordered_map>
+#include <functional>
+#include <stdexcept>
 
 using Hash = unsigned long long;
 
@@ -59,19 +63,27 @@ private:
     PlaceHolder* inner;
 
 public:
-    Hash hash;
+    mutable Hash hash;
+    mutable bool hashed; // 0 is a valid hash, so we can't use it as the "not computed" sentinel
 
     template<typename T, typename std::enable_if<
             std::is_base_of<IHash, T>::value, int>::type = 0>
-    HashWrapper(T value): inner(new Holder<T>(value)), hash(0) {}
+    HashWrapper(T value): inner(new Holder<T>(value)), hash(0), hashed(false) {}
 
-    HashWrapper(const HashWrapper& other): inner(other.inner->clone()), hash(other.hash) {}
+    HashWrapper(const HashWrapper& other):
+        inner(other.inner->clone()), hash(other.hash), hashed(other.hashed) {}
+
+    HashWrapper(HashWrapper&& other) noexcept:
+        inner(other.inner), hash(other.hash), hashed(other.hashed) {
+        other.inner = nullptr;
+    }
 
     HashWrapper& operator = (const HashWrapper &other) {
         if (this != &other) {
             delete inner;
             inner = other.inner->clone();
             hash = other.hash;
+            hashed = other.hashed;
         }
         return *this;
     }
@@ -126,10 +138,11 @@ void register_hashes() {
     register_hash<Int>();
 }
 
-Hash get_hash(HashWrapper &v) {
-    if (v.hash) return v.hash;
+Hash get_hash(const HashWrapper &v) {
+    if (v.hashed) return v.hash;
     auto it = hash_functions.find(v.type());
     if (it != hash_functions.end()) {
+        v.hashed = true;
         return v.hash = it->second(v);
     }
     throw std::runtime_error("No hash function registered for the given type");
@@ -154,14 +167,14 @@ private:
 
     Tag tag;
 
-    static Hash hash_INT(const Integer &i) {
-        return i >= 0 ? i : ~i;
-    }
+    // Computed on the first call to hash(), then carried along with every copy of the key.
+    mutable bool hashed;
+    mutable Hash hash_value;
 
     static Hash hash_NUM(const Number &n) {
         int power;
         auto tail = frexp(n, &power) * -(double)std::numeric_limits<int>::min();
-        if (isnan(tail) || isinf(tail))
+        if (std::isnan(tail) || std::isinf(tail))
             return 0;
         return (Hash)tail + power;
     }
@@ -170,18 +183,23 @@ private:
         return (Hash)p;
     }
 
-    static Hash hash_STR(const std::string &s) {
+    static Hash hash_H(const HashWrapper &h) {
+        return get_hash(h);
+    }
+
+public:
+    /// INT 与 STR key 的 hash，可以在编译期计算，见 FixedTable
+    static constexpr Hash hash_INT(Integer i) {
+        return i >= 0 ? i : ~i;
+    }
+
+    static constexpr Hash hash_STR(std::string_view s) {
         Hash hash = 1829732;
         for (const auto &c: s)
             hash ^= (hash << 5) + (hash >> 2) + c;
         return hash;
     }
 
-    static Hash hash_H(HashWrapper &h) {
-        return get_hash(h);
-    }
-
-public:
     bool operator == (const Key& other) const {
         if (tag != other.tag)
             return false;
@@ -195,20 +213,34 @@ public:
     }
 
     [[nodiscard]] Integer item() const { return i; }
+
+    [[nodiscard]] void* pointer() const { return p; }
+
+    [[nodiscard]] const std::string& str() const { return s; }
     
     Key() = delete;
 
-    Key(const Key &other): tag(other.tag) {
+    Key(const Key &other): tag(other.tag), hashed(other.hashed), hash_value(other.hash_value) {
+        switch (tag) {
+            case INT: i = other.i; break;
+            case NUM: n = other.n; break;
+            case PTR: p = other.p; break;
+            case STR: new (&s) std::string(other.s); break;
+            case H: new (&h) HashWrapper(other.h); break;
+        }
+    }
+
+    Key(Key &&other) noexcept: tag(other.tag), hashed(other.hashed), hash_value(other.hash_value) {
         switch (tag) {
             case INT: i = other.i; break;
             case NUM: n = other.n; break;
             case PTR: p = other.p; break;
-            case STR: s = other.s; break;
-            case H: h = other.h; break;
+            case STR: new (&s) std::string(std::move(other.s)); break;
+            case H: new (&h) HashWrapper(std::move(other.h)); break;
         }
     }
 
-    template<class T> Key(T value) {
+    template<class T> Key(T value): hashed(false), hash_value(0) {
         if constexpr (std::is_integral_v<T>) {
             i = value, tag = INT;
         } else if constexpr (std::is_floating_point_v<T>) {
@@ -233,17 +265,20 @@ public:
         }
     }
 
-    Hash hash() {
+    Hash hash() const {
+        if (hashed) return hash_value;
         switch (tag) {
-            case INT: return hash_INT(i);
-            case NUM: return hash_NUM(n);
-            case STR: return hash_STR(s);
-            case PTR: return hash_PTR(p);
-            case H: return hash_H(h);
+            case INT: hash_value = hash_INT(i); break;
+            case NUM: hash_value = hash_NUM(n); break;
+            case STR: hash_value = hash_STR(s); break;
+            case PTR: hash_value = hash_PTR(p); break;
+            case H: hash_value = hash_H(h); break;
         }
+        hashed = true;
+        return hash_value;
     }
 
-    Tag type() { return tag; }
+    [[nodiscard]] Tag type() const { return tag; }
 };
 
 #endif //TABLE_HASHWRAPPER_H
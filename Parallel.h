@@ -0,0 +1,60 @@
+#ifndef TABLE_PARALLEL_H
+#define TABLE_PARALLEL_H
+
+#include "Table.h"
+#include "ThreadPool.h"
+
+/// Table 的并行遍历。array 部分按连续区间、hash 部分按 slot 区间切成若干段（见 Table::slot_count），
+/// 交给 work-stealing 线程池执行。段数比线程数多，慢的段会被其他线程分担。遍历期间不能修改 Table
+class Parallel {
+private:
+    static const unsigned long MIN_CHUNK = 1 << 14; // positions, smaller scans aren't worth a task
+    static const unsigned CHUNKS_PER_THREAD = 8;
+
+    /// 把 [0, table.slot_count()) 切成若干段，对每段调用 f(chunk, begin, end)，返回段数
+    template<class F>
+    static unsigned long split(Table &table, ThreadPool &pool, F f) {
+        table.finish_rehash();
+        auto total = table.slot_count();
+        auto chunks = std::max(1ul, std::min<unsigned long>(pool.size() * CHUNKS_PER_THREAD, total / MIN_CHUNK));
+        pool.parallel_for(chunks, [&](unsigned long chunk) {
+            f(chunk, total * chunk / chunks, total * (chunk + 1) / chunks);
+        });
+        return chunks;
+    }
+
+public:
+    /// 并行地访问每个 entry，f 的参数为 (const Key&, std::shared_ptr<Value>&)，会被多个线程同时调用
+    template<class F>
+    static void for_each(Table &table, F f, ThreadPool &pool = ThreadPool::global()) {
+        split(table, pool, [&](unsigned long, unsigned long begin, unsigned long end) {
+            table.for_each_in(begin, end, f);
+        });
+    }
+
+    /// 并行地把每个 value 替换为 f(key, value)
+    template<class F>
+    static void transform_values(Table &table, F f, ThreadPool &pool = ThreadPool::global()) {
+        for_each(table, [&](const Key &key, std::shared_ptr<Value> &value) {
+            *value = f(key, static_cast<const Value&>(*value));
+        }, pool);
+    }
+
+    /// 并行地计算 combine(... combine(init, map(k1, v1)) ..., map(kn, vn))。
+    /// 各段分别从 init 开始累积，所以 init 需要是 combine 的单位元，combine 需要满足结合律
+    template<class T, class Map, class Combine>
+    static T reduce(Table &table, T init, Map map, Combine combine, ThreadPool &pool = ThreadPool::global()) {
+        std::vector<T> partial(pool.size() * CHUNKS_PER_THREAD, init);
+        auto chunks = split(table, pool, [&](unsigned long chunk, unsigned long begin, unsigned long end) {
+            auto &result = partial[chunk];
+            table.for_each_in(begin, end, [&](const Key &key, std::shared_ptr<Value> &value) {
+                result = combine(std::move(result), map(key, static_cast<const Value&>(*value)));
+            });
+        });
+        for (unsigned long chunk = 0; chunk < chunks; chunk++)
+            init = combine(std::move(init), std::move(partial[chunk]));
+        return init;
+    }
+};
+
+#endif //TABLE_PARALLEL_H
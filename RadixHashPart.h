@@ -0,0 +1,522 @@
+#ifndef TABLE_RADIXHASHPART_H
+#define TABLE_RADIXHASHPART_H
+
+#include "HashPart.h"
+#include <limits>
+
+/// INT key 使用自适应基数树 (ART) 保存的 hash 部分，其余的 key 放在一个开放寻址表中。
+/// 稀疏的 64 位整数 key 占用的内存更少，并且可以按顺序遍历与范围查询
+class RadixHashPart: public IHashPart {
+private:
+    // Flip the sign bit so that byte-wise order of the encoded key matches the signed order.
+    static uint64_t encode(Integer i) { return (uint64_t)i ^ (1ull << 63); }
+    static Integer decode(uint64_t k) { return (Integer)(k ^ (1ull << 63)); }
+
+    /// key 的第 depth 个字节，从最高位开始数
+    static uint8_t byte_at(uint64_t k, unsigned depth) { return (uint8_t)(k >> (56 - 8 * depth)); }
+
+    /// 高 depth 个字节的掩码
+    static uint64_t high_mask(unsigned depth) { return depth == 0 ? 0 : ~0ull << (64 - 8 * depth); }
+
+    struct Leaf {
+        uint64_t key;
+        std::shared_ptr<Value> value;
+    };
+
+    enum Kind: uint8_t { N4, N16, N48, N256 };
+
+    // Inner nodes keep the whole key prefix above them instead of only the compressed part,
+    // so a single comparison checks the path and removing a level never needs prefix merging.
+    struct Inner {
+        Kind kind;
+        uint8_t depth; // index of the key byte this node branches on
+        uint16_t count;
+        uint64_t prefix; // the high `depth` bytes shared by every key below this node
+    };
+
+    struct Node4: Inner {
+        uint8_t keys[4];
+        void* children[4];
+    };
+
+    struct Node16: Inner {
+        uint8_t keys[16];
+        void* children[16];
+    };
+
+    struct Node48: Inner {
+        uint8_t index[256]; // 0 for none, otherwise position + 1
+        void* children[48];
+    };
+
+    struct Node256: Inner {
+        void* children[256];
+    };
+
+    // Children are either inner nodes or leaves, leaves are tagged by the lowest bit.
+    static bool is_leaf(void* n) { return (uintptr_t)n & 1; }
+    static Leaf* as_leaf(void* n) { return (Leaf*)((uintptr_t)n & ~(uintptr_t)1); }
+    static void* tag_leaf(Leaf* l) { return (void*)((uintptr_t)l | 1); }
+
+    /// 叶子从整块分配的内存中取出，避免每个 key 一次 malloc
+    class LeafPool {
+    private:
+        static const unsigned CHUNK = 1024;
+
+        union Cell {
+            Leaf leaf;
+            Cell* next_free;
+            Cell() {}
+            ~Cell() {}
+        };
+
+        std::vector<std::unique_ptr<Cell[]>> chunks;
+        Cell* free_list = nullptr;
+        unsigned used = CHUNK; // cells taken from the last chunk
+
+    public:
+        Leaf* make(uint64_t key, const std::shared_ptr<Value> &value) {
+            Cell* cell;
+            if (free_list != nullptr) {
+                cell = free_list, free_list = free_list->next_free;
+            } else {
+                if (used == CHUNK)
+                    chunks.emplace_back(new Cell[CHUNK]), used = 0;
+                cell = &chunks.back()[used++];
+            }
+            return new (&cell->leaf) Leaf{ key, value };
+        }
+
+        void release(Leaf* leaf) {
+            leaf->~Leaf();
+            auto cell = (Cell*)leaf;
+            cell->next_free = free_list, free_list = cell;
+        }
+    };
+
+    void* root;
+    unsigned long count;
+    unsigned long capacity;
+    LeafPool leaves;
+    ProbingPart<GenericTraits> others;
+
+    template<class T>
+    static T* make_inner(Kind kind, unsigned depth, uint64_t prefix) {
+        auto node = new T();
+        node->kind = kind, node->depth = depth, node->count = 0, node->prefix = prefix & high_mask(depth);
+        return node;
+    }
+
+    /// 返回 node 中字节 b 对应的子节点位置，不存在时返回 nullptr
+    static void** find_child(Inner* node, uint8_t b) {
+        switch (node->kind) {
+            case N4: {
+                auto n = (Node4*)node;
+                for (unsigned i = 0; i < n->count; i++)
+                    if (n->keys[i] == b) return &n->children[i];
+                return nullptr;
+            }
+            case N16: {
+                auto n = (Node16*)node;
+                for (unsigned i = 0; i < n->count; i++)
+                    if (n->keys[i] == b) return &n->children[i];
+                return nullptr;
+            }
+            case N48: {
+                auto n = (Node48*)node;
+                return n->index[b] ? &n->children[n->index[b] - 1] : nullptr;
+            }
+            case N256: {
+                auto n = (Node256*)node;
+                return n->children[b] ? &n->children[b] : nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    /// 有序数组形式的节点 (N4, N16) 中插入子节点，keys 保持有序
+    template<class T>
+    static void insert_sorted(T* n, uint8_t b, void* child) {
+        unsigned i = n->count;
+        while (i > 0 && n->keys[i - 1] > b) {
+            n->keys[i] = n->keys[i - 1], n->children[i] = n->children[i - 1];
+            i--;
+        }
+        n->keys[i] = b, n->children[i] = child;
+        n->count++;
+    }
+
+    /// 向 *ref 指向的节点加入子节点，节点满时换成更大的节点
+    static void add_child(void** ref, uint8_t b, void* child) {
+        auto node = (Inner*)*ref;
+        switch (node->kind) {
+            case N4: {
+                auto n = (Node4*)node;
+                if (n->count < 4) {
+                    insert_sorted(n, b, child);
+                    return;
+                }
+                auto grown = make_inner<Node16>(N16, n->depth, n->prefix);
+                for (unsigned i = 0; i < 4; i++)
+                    grown->keys[i] = n->keys[i], grown->children[i] = n->children[i];
+                grown->count = 4;
+                insert_sorted(grown, b, child);
+                delete n, *ref = grown;
+                return;
+            }
+            case N16: {
+                auto n = (Node16*)node;
+                if (n->count < 16) {
+                    insert_sorted(n, b, child);
+                    return;
+                }
+                auto grown = make_inner<Node48>(N48, n->depth, n->prefix);
+                for (unsigned i = 0; i < 16; i++)
+                    grown->index[n->keys[i]] = i + 1, grown->children[i] = n->children[i];
+                grown->index[b] = 17, grown->children[16] = child;
+                grown->count = 17;
+                delete n, *ref = grown;
+                return;
+            }
+            case N48: {
+                auto n = (Node48*)node;
+                if (n->count < 48) {
+                    // erase keeps children packed, so the first free position is count
+                    n->index[b] = n->count + 1, n->children[n->count] = child;
+                    n->count++;
+                    return;
+                }
+                auto grown = make_inner<Node256>(N256, n->depth, n->prefix);
+                for (unsigned i = 0; i < 256; i++)
+                    if (n->index[i]) grown->children[i] = n->children[n->index[i] - 1];
+                grown->children[b] = child;
+                grown->count = 49;
+                delete n, *ref = grown;
+                return;
+            }
+            case N256: {
+                auto n = (Node256*)node;
+                n->children[b] = child;
+                n->count++;
+                return;
+            }
+        }
+    }
+
+    /// 从 *ref 指向的节点删除字节 b 对应的子节点，节点过空时换成更小的节点
+    static void remove_child(void** ref, uint8_t b) {
+        auto node = (Inner*)*ref;
+        switch (node->kind) {
+            case N4: case N16: {
+                auto keys = node->kind == N4 ? ((Node4*)node)->keys : ((Node16*)node)->keys;
+                auto children = node->kind == N4 ? ((Node4*)node)->children : ((Node16*)node)->children;
+                unsigned i = 0;
+                while (keys[i] != b) i++;
+                for (; i + 1 < node->count; i++)
+                    keys[i] = keys[i + 1], children[i] = children[i + 1];
+                node->count--;
+                if (node->kind == N4 && node->count == 1) {
+                    // a single child replaces the node, it already carries its full prefix
+                    *ref = children[0];
+                    delete (Node4*)node;
+                } else if (node->kind == N16 && node->count == 3) {
+                    auto n = (Node16*)node;
+                    auto shrunk = make_inner<Node4>(N4, n->depth, n->prefix);
+                    for (unsigned j = 0; j < 3; j++)
+                        shrunk->keys[j] = n->keys[j], shrunk->children[j] = n->children[j];
+                    shrunk->count = 3;
+                    delete n, *ref = shrunk;
+                }
+                return;
+            }
+            case N48: {
+                auto n = (Node48*)node;
+                auto pos = n->index[b] - 1;
+                n->index[b] = 0;
+                n->count--;
+                // move the last child into the hole to keep children packed
+                if (pos != n->count) {
+                    n->children[pos] = n->children[n->count];
+                    for (unsigned i = 0; i < 256; i++)
+                        if (n->index[i] == n->count + 1) {
+                            n->index[i] = pos + 1;
+                            break;
+                        }
+                }
+                if (n->count == 12) {
+                    auto shrunk = make_inner<Node16>(N16, n->depth, n->prefix);
+                    for (unsigned i = 0; i < 256; i++)
+                        if (n->index[i])
+                            insert_sorted(shrunk, i, n->children[n->index[i] - 1]);
+                    delete n, *ref = shrunk;
+                }
+                return;
+            }
+            case N256: {
+                auto n = (Node256*)node;
+                n->children[b] = nullptr;
+                n->count--;
+                if (n->count == 37) {
+                    auto shrunk = make_inner<Node48>(N48, n->depth, n->prefix);
+                    for (unsigned i = 0; i < 256; i++)
+                        if (n->children[i]) {
+                            shrunk->children[shrunk->count] = n->children[i];
+                            shrunk->index[i] = ++shrunk->count;
+                        }
+                    delete n, *ref = shrunk;
+                }
+                return;
+            }
+        }
+    }
+
+    Leaf* find_leaf(uint64_t k) const {
+        auto n = root;
+        while (n != nullptr) {
+            if (is_leaf(n)) {
+                auto leaf = as_leaf(n);
+                return leaf->key == k ? leaf : nullptr;
+            }
+            auto inner = (Inner*)n;
+            if ((k & high_mask(inner->depth)) != inner->prefix)
+                return nullptr;
+            auto child = find_child(inner, byte_at(k, inner->depth));
+            n = child ? *child : nullptr;
+        }
+        return nullptr;
+    }
+
+    /// 插入一个不在树中的 key
+    void insert_leaf(uint64_t k, const std::shared_ptr<Value> &value) {
+        auto leaf = tag_leaf(leaves.make(k, value));
+        void** ref = &root;
+        while (true) {
+            auto n = *ref;
+            if (n == nullptr) {
+                *ref = leaf;
+                return;
+            }
+
+            // the first byte where k leaves the path to n, if it does leave it
+            uint64_t path, mask;
+            if (is_leaf(n)) {
+                path = as_leaf(n)->key, mask = ~0ull;
+            } else {
+                path = ((Inner*)n)->prefix, mask = high_mask(((Inner*)n)->depth);
+            }
+
+            auto diff = (k ^ path) & mask;
+            if (diff != 0) {
+                unsigned depth = __builtin_clzll(diff) / 8;
+                auto split = make_inner<Node4>(N4, depth, k);
+                insert_sorted(split, byte_at(path, depth), n);
+                insert_sorted(split, byte_at(k, depth), leaf);
+                *ref = split;
+                return;
+            }
+
+            auto inner = (Inner*)n;
+            auto child = find_child(inner, byte_at(k, inner->depth));
+            if (child == nullptr) {
+                add_child(ref, byte_at(k, inner->depth), leaf);
+                return;
+            }
+            ref = child;
+        }
+    }
+
+    void erase_leaf(uint64_t k) {
+        void** ref = &root;
+        void** parent = nullptr;
+        while (*ref != nullptr) {
+            auto n = *ref;
+            if (is_leaf(n)) {
+                auto leaf = as_leaf(n);
+                if (leaf->key != k)
+                    return;
+                leaves.release(leaf);
+                count--;
+                if (parent == nullptr)
+                    root = nullptr;
+                else
+                    remove_child(parent, byte_at(k, ((Inner*)*parent)->depth));
+                return;
+            }
+            auto inner = (Inner*)n;
+            if ((k & high_mask(inner->depth)) != inner->prefix)
+                return;
+            auto child = find_child(inner, byte_at(k, inner->depth));
+            if (child == nullptr)
+                return;
+            parent = ref, ref = child;
+        }
+    }
+
+    /// 按 key 从小到大访问子树中落在 [lo, hi] 的叶子
+    template<class F>
+    static void scan_node(void* n, uint64_t lo, uint64_t hi, F &f) {
+        if (is_leaf(n)) {
+            auto leaf = as_leaf(n);
+            if (lo <= leaf->key && leaf->key <= hi)
+                f(leaf);
+            return;
+        }
+        auto inner = (Inner*)n;
+        auto mask = high_mask(inner->depth);
+        if ((inner->prefix | ~mask) < lo || inner->prefix > hi)
+            return;
+        switch (inner->kind) {
+            case N4: {
+                auto node = (Node4*)inner;
+                for (unsigned i = 0; i < node->count; i++)
+                    scan_node(node->children[i], lo, hi, f);
+                return;
+            }
+            case N16: {
+                auto node = (Node16*)inner;
+                for (unsigned i = 0; i < node->count; i++)
+                    scan_node(node->children[i], lo, hi, f);
+                return;
+            }
+            case N48: {
+                auto node = (Node48*)inner;
+                for (unsigned i = 0; i < 256; i++)
+                    if (node->index[i])
+                        scan_node(node->children[node->index[i] - 1], lo, hi, f);
+                return;
+            }
+            case N256: {
+                auto node = (Node256*)inner;
+                for (unsigned i = 0; i < 256; i++)
+                    if (node->children[i])
+                        scan_node(node->children[i], lo, hi, f);
+                return;
+            }
+        }
+    }
+
+    void destroy(void* n) {
+        if (n == nullptr)
+            return;
+        if (is_leaf(n)) {
+            leaves.release(as_leaf(n));
+            return;
+        }
+        scan_children(n, [&](void* child) { destroy(child); });
+        switch (((Inner*)n)->kind) {
+            case N4: delete (Node4*)n; break;
+            case N16: delete (Node16*)n; break;
+            case N48: delete (Node48*)n; break;
+            case N256: delete (Node256*)n; break;
+        }
+    }
+
+    template<class F>
+    static void scan_children(void* n, F f) {
+        auto inner = (Inner*)n;
+        switch (inner->kind) {
+            case N4: for (unsigned i = 0; i < inner->count; i++) f(((Node4*)n)->children[i]); break;
+            case N16: for (unsigned i = 0; i < inner->count; i++) f(((Node16*)n)->children[i]); break;
+            case N48: for (unsigned i = 0; i < inner->count; i++) f(((Node48*)n)->children[i]); break;
+            case N256: for (auto child: ((Node256*)n)->children) if (child) f(child); break;
+        }
+    }
+
+public:
+    explicit RadixHashPart(unsigned long hash_size_log2):
+        root(nullptr), count(0), capacity(1ul << hash_size_log2) {}
+
+    RadixHashPart(const RadixHashPart&) = delete;
+    RadixHashPart& operator = (const RadixHashPart&) = delete;
+
+    ~RadixHashPart() override {
+        destroy(root);
+    }
+
+    std::shared_ptr<Value>* find(const Key &key) override {
+        if (key.type() != INT)
+            return others.find(key, key.hash());
+        auto leaf = find_leaf(encode(key.item()));
+        return leaf ? &leaf->value : nullptr;
+    }
+
+    bool insert(const Key &key, const std::shared_ptr<Value> &value) override {
+        auto slot = find(key);
+        if (slot != nullptr) {
+            *slot = value;
+            return true;
+        }
+        if (size() >= capacity)
+            return false;
+        if (key.type() != INT) {
+            others.insert(key, key.hash(), value);
+        } else {
+            insert_leaf(encode(key.item()), value);
+            count++;
+        }
+        return true;
+    }
+
+    void erase(const Key &key) override {
+        if (key.type() != INT)
+            others.erase(key, key.hash());
+        else
+            erase_leaf(encode(key.item()));
+    }
+
+    [[nodiscard]] unsigned long size() const override {
+        return count + others.size();
+    }
+
+    [[nodiscard]] unsigned long slot_count() const override {
+        return 256 + others.capacity();
+    }
+
+    /// 位置 b < 256 是最高字节为 b 的 INT key，之后是其余 key 的 slot
+    void for_each_in(unsigned long begin, unsigned long end, const std::function<void(const Key&, std::shared_ptr<Value>&)> &f) override {
+        if (begin < std::min(end, 256ul) && root != nullptr) {
+            uint64_t lo = (uint64_t)begin << 56, hi = end >= 256 ? ~0ull : ((uint64_t)end << 56) - 1;
+            auto visit = [&](Leaf* leaf) { f(Key(decode(leaf->key)), leaf->value); };
+            scan_node(root, lo, hi, visit);
+        }
+        if (end > 256)
+            others.for_each(std::max(begin, 256ul) - 256, end - 256, [&](auto &slot) { f(*slot.key, slot.value); });
+    }
+
+    void for_each_int(const std::function<void(Integer)> &f) override {
+        scan(std::numeric_limits<Integer>::min(), std::numeric_limits<Integer>::max(),
+             [&](Integer i, std::shared_ptr<Value>&) { f(i); });
+    }
+
+    void extract_ints(Integer base, unsigned long size, const std::function<void(Integer, std::shared_ptr<Value>&&)> &f) override {
+        if (size == 0 || root == nullptr)
+            return;
+        auto lo = encode(base), hi = lo + (size - 1);
+        if (hi < lo) hi = ~0ull; // the range runs past the largest key
+
+        std::vector<uint64_t> keys;
+        auto take = [&](Leaf* leaf) {
+            f(decode(leaf->key), std::move(leaf->value));
+            keys.push_back(leaf->key);
+        };
+        scan_node(root, lo, hi, take);
+        for (auto k: keys)
+            erase_leaf(k);
+    }
+
+    void resize(unsigned long hash_size_log2) override {
+        capacity = 1ul << hash_size_log2;
+        others.shrink();
+    }
+
+    /// 按从小到大的顺序访问 [lo, hi] 中的 INT key
+    template<class F>
+    void scan(Integer lo, Integer hi, F f) {
+        if (root == nullptr || lo > hi)
+            return;
+        auto visit = [&](Leaf* leaf) { f(decode(leaf->key), leaf->value); };
+        scan_node(root, encode(lo), encode(hi), visit);
+    }
+};
+
+#endif //TABLE_RADIXHASHPART_H
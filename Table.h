@@ -6,34 +6,206 @@
 #define TABLE_TABLE_H
 
 #include "HashWrapper.h"
+#include "TaggedHashPart.h"
+#include "RadixHashPart.h"
+#include "CompactHashPart.h"
+#include "ExtendibleHashPart.h"
+#include "TimerWheel.h"
+#include "ThreadPool.h"
+#include "ArrayPart.h"
 #include <utility>
 #include <vector>
 #include <optional>
-
-using Value = std::any;
+#include <cassert>
+#include <array>
+#include <chrono>
+#include <algorithm>
+#include <tuple>
+#include <thread>
+#include <atomic>
+#include <limits>
 
 const int MAX_BIT = 64;
 
+/// hash 部分的实现方式
+enum Layout {
+    CHAINED, // Lua 风格的链式 hash，节点数组内部解决冲突
+    TAGGED, // 每种 tag 一个子表，见 TaggedHashPart
+    RADIX, // INT key 保存在基数树中，见 RadixHashPart
+    COMPACT, // entry 按插入顺序紧密存放，见 CompactHashPart
+    EXTENDIBLE, // 可扩展 hash，段满时各自分裂，见 ExtendibleHashPart
+};
+
+/// 布局的名字，与枚举值同名
+inline const char* layout_name(Layout layout) {
+    switch (layout) {
+        case CHAINED: return "CHAINED";
+        case TAGGED: return "TAGGED";
+        case RADIX: return "RADIX";
+        case COMPACT: return "COMPACT";
+        case EXTENDIBLE: return "EXTENDIBLE";
+    }
+    return "?";
+}
+
+/// Table::partition 按什么把 key 分到各个分区
+enum Partitioning {
+    BY_HASH, // 按 hash 均匀地分
+    BY_RANGE, // INT key 按大小切成个数相近的连续区间，其余的 key 按 hash 分
+};
+
+/// 一次 resize 的统计信息，由 recompute_size 或后台 rehash 填写
+struct ResizeEvent {
+    unsigned long old_array_size_log2, old_hash_size_log2;
+    unsigned long new_array_size_log2, new_hash_size_log2;
+    Integer old_array_base, new_array_base;
+
+    // Entries stored in each part. Before the resize they describe the old layout, after the
+    // resize the new one. The key waiting to be inserted is not counted.
+    unsigned long array_entries, hash_entries;
+
+    // counter[b] is the number of positive integer keys whose highest bit is b.
+    std::array<unsigned long, MAX_BIT> counter;
+
+    // Time spent since the rehash started: histogram only in before_resize, the whole pause in
+    // after_resize.
+    std::chrono::nanoseconds elapsed;
+
+    // Layout of the hash part. Only the adaptive mode changes it, see Table::set_adaptive_layout.
+    // layout_reason names the rule behind new_layout, nullptr when nothing was decided.
+    Layout old_layout, new_layout;
+    const char* layout_reason;
+
+    // Lookups sampled since the last resize and the ones that missed; chains walked by sampled
+    // lookups and inserts and the nodes they compared (CHAINED only). All zero unless the adaptive
+    // mode is on.
+    unsigned long sampled_lookups, sampled_misses, sampled_walks, sampled_steps;
+
+    // The new parts were built by a background rehash, see Table::set_background_rehash.
+    // before_resize then runs at the freeze and only knows the old sizes and layout; in after_resize
+    // the entry counts and counter describe the frozen parts, and elapsed is the time finish_rehash
+    // spent on the caller's thread.
+    bool background;
+};
+
+/// 监听 Table 的 resize，可用于记录 rehash 造成的停顿
+class IResizeObserver {
+public:
+    virtual ~IResizeObserver() = default;
+    virtual void before_resize(const ResizeEvent&) {}
+    virtual void after_resize(const ResizeEvent&) {}
+};
+
 class Table {
 private:
-    struct Node {
-        std::shared_ptr<Key> key;
-        std::shared_ptr<Value> value;
-        Node* next;
-        Node* vacancy_next;
+    /// hash 部分的节点，32 字节，一条 cache line 可以放下两个
+    struct alignas(32) Node {
+        union {
+            Integer i; // INT and PTR keys are stored inline
+            void* p;
+            Key* key; // other keys are owned by the node
+            int32_t vacancy_next; // free nodes: offset to the next node of the vacancy list
+        };
+        std::shared_ptr<Value> value; // nullptr iff the node is free
+        uint32_t meta; // tag in the low 3 bits, the rest is the hash folded to 32 bits
+        // Offset to the next node of the chain (0 for none), relative to this node as Lua does.
+        // Free nodes reuse it as the offset to the previous node of the vacancy list.
+        int32_t next;
+
+        Node(): key(nullptr), value(nullptr), meta(0), next(0) {}
+
+        Node(const Node&) = delete;
+        Node& operator = (const Node&) = delete;
+
+        ~Node() {
+            release();
+        }
+
+        static uint32_t pack(Hash h, Tag tag) {
+            return (((uint32_t)(h >> 32) ^ (uint32_t)h) & ~7u) | tag;
+        }
+
+        static bool is_inline(Tag tag) {
+            return tag == INT || tag == PTR;
+        }
+
+        [[nodiscard]] Tag type() const {
+            return (Tag)(meta & 7);
+        }
+
+        [[nodiscard]] Integer item() const {
+            return i;
+        }
+
+        /// 节点中 key 的 hash，内联的 key 重新计算，其余的 key 自带缓存
+        [[nodiscard]] Hash hash() const {
+            switch (type()) {
+                case INT: return Key(i).hash();
+                case PTR: return Key(p).hash();
+                default: return key->hash();
+            }
+        }
+
+        /// 节点中的 key，内联的 key 重新构造
+        [[nodiscard]] Key get_key() const {
+            switch (type()) {
+                case INT: return Key(i);
+                case PTR: return Key(p);
+                default: return *key;
+            }
+        }
+
+        Node* next_node() {
+            return next ? this + next : nullptr;
+        }
+
+        void link(Node* node) {
+            next = node ? (int32_t)(node - this) : 0;
+        }
+
+        /// 用 key 与 value 填充一个空节点
+        void fill(const Key &k, std::shared_ptr<Value> v, Hash h) {
+            switch (k.type()) {
+                case INT: i = k.item(); break;
+                case PTR: p = k.pointer(); break;
+                default: key = new Key(k); break;
+            }
+            value = std::move(v);
+            meta = pack(h, k.type()), next = 0;
+        }
+
+        /// 把 from 的 entry 移动到这个空节点，from 变为空节点，链接关系由调用者维护
+        void take(Node* from) {
+            if (is_inline(from->type()))
+                i = from->i;
+            else
+                key = from->key;
+            value = std::move(from->value);
+            meta = from->meta, next = 0;
+        }
 
-        Node(const std::shared_ptr<Key> &key, const std::shared_ptr<Value> &value):
-                next(nullptr), vacancy_next(nullptr) {
-            this->key = key;
-            this->value = value;
+        /// 释放节点拥有的 key 与 value
+        void release() {
+            if (value != nullptr && !is_inline(type()))
+                delete key;
+            value.reset();
         }
 
-        Node(): key(nullptr), value(nullptr), next(nullptr) {}
+        /// 先比较 tag 与 hash，只有相同时才比较 key 本身
+        [[nodiscard]] bool matches(Hash h, const Key &other) const {
+            if (meta != pack(h, other.type()))
+                return false;
+            switch (other.type()) {
+                case INT: return i == other.item();
+                case PTR: return p == other.pointer();
+                default: return *key == other;
+            }
+        }
     };
 
     class NodeReference {
     private:
-        std::shared_ptr<Key> key;
+        Key key;
         Table* table;
 
         class Dummy {};
@@ -43,7 +215,7 @@ private:
         }
 
     public:
-        NodeReference(const std::shared_ptr<Key> &key, Table* table): key(key), table(table) {}
+        NodeReference(const Key &key, Table* table): key(key), table(table) {}
         ~NodeReference() = default;
 
 
@@ -101,7 +273,9 @@ private:
 
         /// 将值转化为给定类型的引用
         template<class T> T& into() {
-            auto &value = *unwrap();
+            // the common case, an existing value, doesn't need a reference of its own
+            auto found = table->find(key);
+            auto &value = found != nullptr ? *found : *unwrap();
             if (is_dummy(value)) {
                 value = T();
             }
@@ -114,37 +288,280 @@ private:
     };
 
     std::shared_ptr<Node*> hash;
-    std::shared_ptr<std::shared_ptr<Value>*> array;
+    ArrayPart array;
     Node* vacancy_head;
 
     unsigned long array_size_log2; // array 部分的长度关于 2 的对数，至少为 0
+    Integer array_base; // array 部分的第一个位置对应的 key
     unsigned long hash_size_log2; // hash 部分的长度关于 2 的对数，至少为 1
     unsigned long last_free; // 当前的 free 指针，只会往前移动
+    unsigned long used; // CHAINED 布局中已占用的节点数
+
+    std::vector<std::shared_ptr<IResizeObserver>> observers;
+
+    Layout layout;
+    std::unique_ptr<IHashPart> engine; // nullptr for the CHAINED layout, which uses hash directly
+    unsigned long cache_capacity; // 0 unless the table is used as a cache, see set_capacity()
+    bool background_rehash; // see set_background_rehash()
+
+    using Clock = std::chrono::steady_clock;
+
+    /// TTL entry 的 value 用这个 deleter 创建，过期时间记在 value 的控制块里，节点不需要额外的空间
+    struct Expiring {
+        Clock::time_point deadline;
+
+        void operator () (Value* value) const {
+            delete value;
+        }
+    };
+
+    /// 时间轮中的记录，只有 key 对应的仍是这个 value 时才删除，被覆盖或删除过的 key 不受影响
+    struct Expiry {
+        Key key;
+        std::weak_ptr<Value> value;
+    };
+
+    static constexpr auto TTL_TICK = std::chrono::milliseconds(1);
+    static const unsigned long EXPIRE_STEP = 4; // expired entries reclaimed by each insert
+
+    std::unique_ptr<TimerWheel<Expiry>> timers; // created by the first insert_with_ttl
+    Clock::time_point epoch; // tick 0 of timers
+
+    static bool expired(const std::shared_ptr<Value> &value, Clock::time_point now) {
+        auto expiring = std::get_deleter<Expiring>(value);
+        return expiring != nullptr && expiring->deadline <= now;
+    }
+
+    /// 后台 rehash 的状态。开始时 array 与 hash 部分被冻结，后台线程只读它们建立新的 Table；
+    /// 期间的修改都记在 log 中，查询先查 log。log 预先分配好大小，写满时换一个两倍大的，自己从不 resize。
+    /// 新 Table 建好后，后台线程分轮重放 log：每轮开始时前台换一个新的 log，旧的交给后台线程。
+    /// 剩下的修改足够少时，前台重放它们并换上新的两部分
+    struct Rehash {
+        std::thread worker;
+        std::atomic<bool> ready{false}; // the worker finished its round
+        std::unique_ptr<Table> built;
+        std::exception_ptr error;
+        // Keys changed since the freeze, erased ones map to tombstone(). Only the last log takes
+        // changes, logs before replayed were handed to the worker.
+        std::vector<std::unique_ptr<Table>> logs;
+        unsigned long replayed = 0;
+        unsigned long budget; // changes the new table has room for
+        unsigned long logged = 0, pending = 0; // changes in all logs, not yet handed to the worker
+        unsigned long capacity = 0, filled = 0; // of the last log
+        ResizeEvent event{}; // the worker fills in the counts, the rest is set in the foreground
+    };
+
+    class Tombstone {};
+
+    /// 自适应布局的统计。查找与插入按 key 的 hash 抽样 1/64，只有抽中的操作写计数器，
+    /// 同一个 key 总是被抽中或总是不被抽中，多个只读的线程仍可以同时查找
+    struct Adaptive {
+        static const unsigned SAMPLE_LOG2 = 6;
+
+        std::atomic<unsigned long> lookups{0}, misses{0};
+        // CHAINED only: chains walked by lookups and inserts, and the nodes they compared
+        std::atomic<unsigned long> walks{0}, steps{0};
+
+        static bool sampled(Hash h) {
+            return (h * 0x9E3779B97F4A7C15ull) >> (64 - SAMPLE_LOG2) == 0;
+        }
+
+        void record(bool miss) {
+            lookups.fetch_add(1, std::memory_order_relaxed);
+            misses.fetch_add(miss, std::memory_order_relaxed);
+        }
+
+        void walked(unsigned long compared) {
+            walks.fetch_add(1, std::memory_order_relaxed);
+            steps.fetch_add(compared, std::memory_order_relaxed);
+        }
+    };
+
+    static const unsigned long ADAPT_MIN_LOG2 = 10; // smaller hash parts keep their layout
+    static const unsigned long ADAPT_MIN_SAMPLES = 32; // rules on sampled operations need this many
+    static const unsigned long EXTENDIBLE_LOG2 = 22; // hash parts this large switch to EXTENDIBLE
+
+    std::unique_ptr<Adaptive> adaptive; // non-null in the adaptive mode
+
+    static const unsigned long BACKGROUND_MIN_LOG2 = 12; // smaller hash parts resize inline
+    static const unsigned long CATCH_UP = 1024; // a last log this short is replayed in the foreground
+
+    std::unique_ptr<Rehash> rehash; // non-null while a background rehash is in progress
+    std::thread reaper; // frees the storage replaced by the last background rehash
+
+    /// log 中表示已删除的 value，按地址识别
+    static const std::shared_ptr<Value>& tombstone() {
+        static const auto value = std::make_shared<Value>(Tombstone());
+        return value;
+    }
+
+    static std::unique_ptr<IHashPart> make_hash_part(Layout layout, unsigned long hash_size_log2) {
+        switch (layout) {
+            case TAGGED: return std::make_unique<TaggedHashPart>(hash_size_log2);
+            case RADIX: return std::make_unique<RadixHashPart>(hash_size_log2);
+            case COMPACT: return std::make_unique<CompactHashPart>(hash_size_log2);
+            case EXTENDIBLE: return std::make_unique<ExtendibleHashPart>(hash_size_log2);
+            case CHAINED: break;
+        }
+        return nullptr;
+    }
+
+    // Chains and the vacancy list link nodes by 32-bit offsets. The array part and the other
+    // layouts have no such limit.
+    static const unsigned long MAX_CHAINED_LOG2 = 31;
 
     [[nodiscard]] unsigned long hash_size() const {
-        return 1 << hash_size_log2;
+        return 1ul << hash_size_log2;
     }
 
     [[nodiscard]] unsigned long array_size() const {
-        return 1 << array_size_log2;
+        return 1ul << array_size_log2;
     }
 
-    Node* main_pos(const std::shared_ptr<Key>& key) {
-        return &(*hash)[key->hash() & (hash_size() - 1)];
+    /// 整数 i 是否落在 array 部分 [array_base, array_base + array_size()) 中
+    [[nodiscard]] bool in_array(Integer i) const {
+        // one unsigned comparison checks both ends; a cache keeps every key in the hash part
+        return (unsigned long)i - (unsigned long)array_base < array_size() && cache_capacity == 0;
+    }
+
+    /// 新的 array 部分是否包含现在的整个 array 部分，这时 array 部分可以原地扩大
+    [[nodiscard]] bool covers(unsigned long new_array_size_log2, Integer new_array_base) const {
+        auto new_size = 1ul << new_array_size_log2;
+        return new_size >= array_size() && (unsigned long)array_base - (unsigned long)new_array_base <= new_size - array_size();
+    }
+
+    /// 新的 array 部分是否在现在的 array 部分之内，这时 array 部分可以原地缩小
+    [[nodiscard]] bool within(unsigned long new_array_size_log2, Integer new_array_base) const {
+        auto new_size = 1ul << new_array_size_log2;
+        return new_size <= array_size() && (unsigned long)new_array_base - (unsigned long)array_base <= array_size() - new_size;
+    }
+
+    /// 把 array 部分移到 [new_array_base, new_array_base + 2^new_array_size_log2)。新窗口包含旧窗口时原地扩大，
+    /// 在旧窗口之内时原地缩小，其余情况才重新分配；留在窗口中的 entry 不动，离开窗口的交给 spill(key, value)。
+    /// 返回留在 array 部分中的元素个数
+    template<class F>
+    unsigned long move_window(unsigned long new_array_size_log2, Integer new_array_base, F spill) {
+        auto new_size = 1ul << new_array_size_log2, old_size = array_size();
+        auto in_new_array = [&](Integer i) {
+            return (unsigned long)i - (unsigned long)new_array_base < new_size;
+        };
+
+        unsigned long kept = 0;
+        for (unsigned long i = 0; i < old_size; i++) {
+            auto &slot = array[i];
+            if (slot == nullptr)
+                continue;
+            auto live = slot->has_value();
+            auto key = (Integer)(array_base + i);
+            if (in_new_array(key)) {
+                kept += live;
+                continue;
+            }
+            if (live)
+                spill(key, std::move(slot));
+            slot.reset();
+        }
+
+        if (covers(new_array_size_log2, new_array_base)) {
+            array.grow(new_size, (unsigned long)array_base - (unsigned long)new_array_base);
+        } else if (within(new_array_size_log2, new_array_base)) {
+            array.shrink(new_size, (unsigned long)new_array_base - (unsigned long)array_base);
+        } else {
+            ArrayPart moved(new_size, array.is_paged());
+            for (unsigned long i = 0; i < old_size; i++)
+                if (array[i] != nullptr)
+                    moved[array_base + i - new_array_base] = std::move(array[i]);
+            array.swap(moved);
+        }
+
+        array_size_log2 = new_array_size_log2;
+        array_base = new_array_base;
+        return kept;
+    }
+
+    std::shared_ptr<Value>& array_slot(Integer i) {
+        return array[(unsigned long)i - (unsigned long)array_base];
+    }
+
+    /// 保存 key 的 value 的位置，不存在时返回 nullptr，不检查是否过期
+    std::shared_ptr<Value>* locate(const Key& key) {
+        if (rehash != nullptr) {
+            // the log has the latest word on every key changed since the freeze
+            for (auto log = rehash->logs.rbegin(); log != rehash->logs.rend(); log++)
+                if (auto logged = (*log)->locate(key))
+                    return *logged == tombstone() ? nullptr : logged;
+        }
+
+        if (key.type() == INT && in_array(key.item())) {
+            auto &slot = array_slot(key.item());
+            return slot != nullptr ? &slot : nullptr;
+        }
+
+        if (adaptive != nullptr && Adaptive::sampled(key.hash()))
+            return locate_sampled(key);
+
+        if (engine != nullptr)
+            return engine->find(key);
+
+        auto h = key.hash();
+        auto mp = main_pos(h);
+        while (!is_empty(mp) && !mp->matches(h, key))
+            mp = mp->next_node();
+        return is_empty(mp) ? nullptr : &mp->value;
+    }
+
+    /// 在 hash 部分中查找并记入自适应布局的统计
+    std::shared_ptr<Value>* locate_sampled(const Key& key) {
+        if (engine != nullptr) {
+            auto found = engine->find(key);
+            adaptive->record(found == nullptr);
+            return found;
+        }
+
+        auto h = key.hash();
+        auto mp = main_pos(h);
+        unsigned long compared = 0;
+        while (!is_empty(mp) && (compared++, !mp->matches(h, key)))
+            mp = mp->next_node();
+        adaptive->record(is_empty(mp));
+        adaptive->walked(compared);
+        return is_empty(mp) ? nullptr : &mp->value;
+    }
+
+    Node* main_pos(Hash h) {
+        return &(*hash)[h & (hash_size() - 1)];
     }
 
     static bool is_empty(Node* node) {
         return node == nullptr || node->value == nullptr;
     }
 
+    /// 把空节点从空闲链表中摘下，节点可能本来就不在链表中
+    void unlink_vacancy(Node* node) {
+        // Every listed node except the head has a predecessor.
+        if (node != vacancy_head && node->next == 0)
+            return;
+
+        Node *prev = node->next ? node + node->next : nullptr;
+        Node *succ = node->vacancy_next ? node + node->vacancy_next : nullptr;
+
+        if (prev != nullptr)
+            prev->vacancy_next = succ ? (int32_t)(succ - prev) : 0;
+        else
+            vacancy_head = succ;
+        if (succ != nullptr)
+            succ->next = prev ? (int32_t)(prev - succ) : 0;
+
+        node->vacancy_next = 0, node->next = 0;
+    }
+
     /// 返回 hash 部分的一个空闲位置，这个位置可能不存在
     std::optional<Node*> get_free_pos() {
-        while (vacancy_head != nullptr) {
-            if (is_empty(vacancy_head))
-                return vacancy_head;
-            auto tmp = vacancy_head->vacancy_next;
-            vacancy_head->vacancy_next = nullptr;
-            vacancy_head = tmp;
+        // Nodes are unlinked whenever they get filled, so every listed node is free.
+        if (vacancy_head != nullptr) {
+            auto node = vacancy_head;
+            unlink_vacancy(node);
+            return node;
         }
 
         while (last_free >= 0) {
@@ -158,45 +575,82 @@ private:
         return {};
     }
 
-    /// 重新分配 array 部分与 hash 部分的大小
-    void resize(unsigned long new_array_size_log2, unsigned long new_hash_size_log2) {
-        Table new_table(new_array_size_log2, new_hash_size_log2);
+    /// 重新分配 array 部分与 hash 部分的大小，返回新 array 部分中的元素个数
+    unsigned long resize(unsigned long new_array_size_log2, unsigned long new_hash_size_log2, Integer new_array_base) {
+        if (engine != nullptr)
+            return resize_engine(new_array_size_log2, new_hash_size_log2, new_array_base);
 
         assert(new_hash_size_log2 >= 1);
 
-        auto boundary = std::min(array_size(), (1ul << new_array_size_log2));
-
-        auto array1 = *new_table.array, array2 = *array;
+        // Only the array part grows: the hash part stays, minus the keys the array part now covers.
+        if (new_hash_size_log2 == hash_size_log2 && covers(new_array_size_log2, new_array_base)) {
+            auto new_size = 1ul << new_array_size_log2;
+            std::vector<std::pair<Integer, std::shared_ptr<Value>>> entries;
+            for (unsigned long i = 0; i < hash_size(); i++) {
+                auto &node = (*hash)[i];
+                if (!is_empty(&node) && node.type() == INT && (unsigned long)node.item() - (unsigned long)new_array_base < new_size)
+                    entries.emplace_back(node.item(), node.value);
+            }
+            // erase while the keys still belong to the hash part
+            for (auto &entry: entries)
+                erase(Key(entry.first));
+            auto array_entries = move_window(new_array_size_log2, new_array_base, [](Integer, std::shared_ptr<Value>&&) {});
+            for (auto &[i, value]: entries)
+                array_slot(i) = std::move(value);
+            return array_entries + entries.size();
+        }
 
-        for (auto i = 0; i < boundary; i++)
-            array1[i] = std::move(array2[i]);
+        // Only the hash part is rebuilt. Its array slot stays empty: keys of the new array part
+        // never go there.
+        Table new_table(0, new_hash_size_log2);
+        new_table.array_base = new_array_base;
 
-        for (auto i = boundary; i < array_size(); i++)
-            if (array2[i]->has_value()) {
-                new_table.insert(std::make_shared<Key>(i), array2[i]);
-            }
+        auto array_entries = move_window(new_array_size_log2, new_array_base, [&](Integer key, std::shared_ptr<Value> &&value) {
+            new_table.insert(Key(key), value);
+        });
 
         auto hash2 = *hash;
 
-        for (auto i = 0; i < hash_size(); i++) {
+        for (unsigned long i = 0; i < hash_size(); i++) {
             if (!is_empty(&hash2[i])) {
-                auto &key = hash2[i].key;
-                if (key->type() == INT && key->item() < (1 << new_array_size_log2)) {
-                    array1[key->item()] = std::move(hash2[i].value);
+                auto &node = hash2[i];
+                if (node.type() == INT && in_array(node.item())) {
+                    array_slot(node.item()) = std::move(node.value);
+                    array_entries++;
                 } else {
-                    new_table.insert(hash2[i].key, hash2[i].value);
+                    // the key is handed over to the new table, together with its cached hash
+                    new_table.insert_node(&node, node.hash());
                 }
             }
         }
 
-        std::swap(array, new_table.array);
         std::swap(hash, new_table.hash);
-
-        array_size_log2 = new_array_size_log2;
         hash_size_log2 = new_hash_size_log2;
-
         vacancy_head = new_table.vacancy_head;
         last_free = new_table.last_free;
+        used = new_table.used;
+
+        return array_entries;
+    }
+
+    /// 使用可替换的 hash 部分时，hash 部分原地调整容量，大小不变时不动
+    unsigned long resize_engine(unsigned long new_array_size_log2, unsigned long new_hash_size_log2, Integer new_array_base) {
+        std::vector<std::pair<Integer, std::shared_ptr<Value>>> entries;
+        engine->extract_ints(new_array_base, 1ul << new_array_size_log2, [&](Integer i, std::shared_ptr<Value> &&value) {
+            entries.emplace_back(i, std::move(value));
+        });
+
+        // make room in the hash part before moving entries out of the old array part
+        if (new_hash_size_log2 != hash_size_log2)
+            engine->resize(new_hash_size_log2);
+        hash_size_log2 = new_hash_size_log2;
+
+        auto array_entries = move_window(new_array_size_log2, new_array_base, [&](Integer key, std::shared_ptr<Value> &&value) {
+            engine->insert(Key(key), value);
+        });
+        for (auto &[i, value]: entries)
+            array_slot(i) = std::move(value);
+        return array_entries + entries.size();
     }
 
     template<class T>
@@ -210,179 +664,1053 @@ private:
         clear(v), clear(tails...);
     }
 
+    static constexpr unsigned long WINDOW_BUCKETS_LOG2 = 8; // densest_window counts keys in 2^8 buckets per pass
+
     /// 返回 x 的二进制位数，最低位为第 0 位
     static unsigned bit(unsigned long long x) {
         return MAX_BIT - __builtin_clzll(x) - 1;
     }
 
+    /// 找一个长度为 2^k、超过一半位置被占用的窗口，k 取最大值，返回 k、窗口起点与窗口中 key 的个数。
+    /// each(f) 对每个 INT key 调用一次 f，每一轮遍历一次，只用 O(2^WINDOW_BUCKETS_LOG2) 的内存：
+    /// 把 [min, max] 分成等宽的桶计数，起点在桶边界、长度不小于桶宽的窗口由桶的计数精确得到；
+    /// 更短的窗口只会落在 key 最多的相邻两个桶中，缩小到这两个桶再分一次，直到桶宽为 1 或不可能更好。
+    /// 以 0 为起点的窗口由 key 的最高位计数得到，个数相同时优先
+    template<class F>
+    static std::tuple<unsigned long, Integer, unsigned long> densest_window(F each) {
+        const unsigned long BUCKETS = 1ul << WINDOW_BUCKETS_LOG2;
+
+        // from_zero[k]: keys whose smallest window [0, 2^k) is that one
+        std::array<unsigned long, MAX_BIT + 1> from_zero{};
+        unsigned long n = 0;
+        Integer min = std::numeric_limits<Integer>::max(), max = std::numeric_limits<Integer>::min();
+        each([&](Integer i) {
+            n++, min = std::min(min, i), max = std::max(max, i);
+            if (i >= 0)
+                from_zero[i == 0 ? 0 : bit(i) + 1]++;
+        });
+        if (n == 0)
+            return { 0, 0, 0 };
+
+        // a window of length 2^k holding more than 2^(k-1) keys has k <= bit(n) + 1
+        unsigned long top = std::min(bit(n) + 1, (unsigned)MAX_BIT - 2);
+        unsigned long best_k = 0, best_count = 1;
+        Integer best_base = from_zero[0] ? 0 : min;
+        auto offer = [&](unsigned long k, Integer base, unsigned long count) {
+            if (2 * count <= (1ul << k))
+                return;
+            if (k > best_k || (k == best_k && (count > best_count || (count == best_count && base == 0))))
+                best_k = k, best_base = base, best_count = count;
+        };
+
+        unsigned long below = 0;
+        for (unsigned long k = 0; k <= top; k++)
+            below += from_zero[k], offer(k, 0, below);
+
+        // the buckets cover [lo, lo + BUCKETS * 2^width)
+        Integer lo = min;
+        auto span = max == min ? 0 : bit((Hash)max - (Hash)min) + 1;
+        unsigned long width = span > WINDOW_BUCKETS_LOG2 ? span - WINDOW_BUCKETS_LOG2 : 0;
+        for (;;) {
+            std::array<unsigned long, BUCKETS + 1> prefix{};
+            each([&](Integer i) {
+                auto offset = (Hash)i - (Hash)lo;
+                if (offset >> width < BUCKETS)
+                    prefix[(offset >> width) + 1]++;
+            });
+            for (unsigned long b = 0; b < BUCKETS; b++)
+                prefix[b + 1] += prefix[b];
+
+            for (auto k = width; k <= std::min(top, width + WINDOW_BUCKETS_LOG2); k++) {
+                auto length = 1ul << (k - width);
+                for (unsigned long b = 0; b + length <= BUCKETS; b++)
+                    offer(k, (Integer)((Hash)lo + (b << width)), prefix[b + length] - prefix[b]);
+            }
+
+            // a shorter window lies in two adjacent buckets, and beats the best one only with more keys than 2^best_k
+            if (width == 0 || best_k + 1 >= width)
+                break;
+            unsigned long pair = 0;
+            for (unsigned long b = 0; b + 2 <= BUCKETS; b++)
+                if (prefix[b + 2] - prefix[b] > prefix[pair + 2] - prefix[pair])
+                    pair = b;
+            if (prefix[pair + 2] - prefix[pair] <= (1ul << best_k))
+                break;
+            lo = (Integer)((Hash)lo + (pair << width));
+            width = width + 1 > WINDOW_BUCKETS_LOG2 ? width + 1 - WINDOW_BUCKETS_LOG2 : 0;
+        }
+
+        return { best_k, best_base, best_count };
+    }
+
+    /// 自适应模式下为 hash 部分选择布局，hash_entries 与 int_entries 是 resize 后 hash 部分中的
+    /// entry 数与其中的 INT key 数。规则依次为：很大且采样到的链都很短的 CHAINED 改用 EXTENDIBLE
+    /// （hash 相同的 key 在 EXTENDIBLE 中只能进溢出链，链长只在 CHAINED 中测得出）；几乎都是 INT key 且
+    /// 查找多半落空时用 RADIX；INT 与其他 key 混杂时用 TAGGED；CHAINED 的链过长时改用 TAGGED；
+    /// 其余情况 TAGGED 保持不变（在 TAGGED 中测不出链长，避免来回切换），其他布局回到 CHAINED。
+    /// 返回的原因为 nullptr 时表示数据不够，不做决定
+    [[nodiscard]] std::pair<Layout, const char*> choose_layout(unsigned long hash_entries, unsigned long int_entries) const {
+        if (cache_capacity != 0 || hash_entries < 1ul << ADAPT_MIN_LOG2)
+            return { layout, nullptr };
+
+        auto lookups = adaptive->lookups.load(std::memory_order_relaxed);
+        auto misses = adaptive->misses.load(std::memory_order_relaxed);
+        auto walks = adaptive->walks.load(std::memory_order_relaxed);
+        auto steps = adaptive->steps.load(std::memory_order_relaxed);
+        auto others = hash_entries - std::min(int_entries, hash_entries);
+
+        // leave EXTENDIBLE only at half the size that chose it
+        auto short_chains = walks >= ADAPT_MIN_SAMPLES && steps < 2 * walks;
+        if ((layout == CHAINED && hash_entries >= 1ul << EXTENDIBLE_LOG2 && short_chains) ||
+            (layout == EXTENDIBLE && hash_entries >= 1ul << (EXTENDIBLE_LOG2 - 1)))
+            return { EXTENDIBLE, "large hash part with short chains: segments split one at a time instead of doubling together" };
+        if (10 * int_entries >= 9 * hash_entries && lookups >= ADAPT_MIN_SAMPLES && 2 * misses >= lookups)
+            return { RADIX, "sparse integer keys, mostly missed: the radix tree rejects them at the first differing byte" };
+        if (10 * int_entries >= hash_entries && 10 * others >= hash_entries)
+            return { TAGGED, "mixed key types: one sub-table per tag" };
+        if (layout == CHAINED && walks >= ADAPT_MIN_SAMPLES && !short_chains)
+            return { TAGGED, "long chains: open addressing at load 1/2" };
+        if (layout == TAGGED)
+            return { TAGGED, "no rule applies, chain lengths are not observable here" };
+        return { CHAINED, "no rule applies" };
+    }
+
+    /// 把现有 entries 个 entry 的 hash 部分换成 to 布局，array 部分不动
+    void change_layout(Layout to, unsigned long entries) {
+        // keys of the array part never live in the hash part, so fresh never puts one into its own
+        // one-slot array part, and it has room for every entry without resizing
+        Table fresh(0, bit(entries | 1) + 1, to);
+        fresh.array_base = array_base;
+        visit_in(array_size(), slot_count(), [&](const Key &key, std::shared_ptr<Value> &value) {
+            fresh.insert(key, value);
+        });
+
+        std::swap(hash, fresh.hash);
+        std::swap(engine, fresh.engine);
+        std::swap(hash_size_log2, fresh.hash_size_log2);
+        vacancy_head = fresh.vacancy_head;
+        last_free = fresh.last_free;
+        used = fresh.used;
+        layout = to;
+    }
+
     /// 重新计算 array, hash 两个部分的大小，注意一定会有一个新的元素被插入到 hash 中
     void recompute_size() {
-        static int counter[MAX_BIT];
+        auto start = std::chrono::steady_clock::now();
 
-        for (int i = 0; i < MAX_BIT; i++)
-            counter[i] = 0;
+        ResizeEvent event{};
+        event.old_array_size_log2 = array_size_log2;
+        event.old_hash_size_log2 = hash_size_log2;
+        event.old_array_base = array_base;
 
-        // There are at lease two occupied positions: 0 and the key to insert.
+        auto &counter = event.counter;
+
+        // There is at least one occupied position: the key to insert.
         // At first hash_part represents number of elements either in array or hash, then we will
         // exclude array size from it.
-        unsigned long hash_part = 2;
+        unsigned long hash_part = 1;
+
+        // visits every integer key, the array part first
+        auto each_int = [&](const std::function<void(Integer)> &f) {
+            for (unsigned long i = 0; i < array_size(); i++)
+                if (array[i] != nullptr && array[i]->has_value())
+                    f((Integer)(array_base + i));
+            if (engine != nullptr)
+                engine->for_each_int(f);
+            else for (unsigned long i = 0; i < hash_size(); i++)
+                if (!is_empty(&(*hash)[i]) && (*hash)[i].type() == INT)
+                    f((*hash)[i].item());
+        };
 
-        auto push_into_counter = [&](long long i) {
+        unsigned long ints = 0;
+        each_int([&](Integer i) {
+            ints++;
             if (i >= 1) counter[bit(i)]++;
-        };
+        });
 
-        auto array1 = *array; // array deref
+        for (unsigned long i = 0; i < array_size(); i++)
+            if (array[i] != nullptr && array[i]->has_value())
+                event.array_entries++;
+        event.hash_entries = engine != nullptr ? engine->size() : used;
+        hash_part += event.array_entries + event.hash_entries;
 
-        // Skip array[0], which is supposed to be occupied.
-        for (int i = 1; i < array_size(); i++)
-            if (array1[i] != nullptr && array1[i]->has_value()) {
-                push_into_counter(i);
-                hash_part++;
-            }
+        auto [new_array_size_log2, new_array_base, array_part] = densest_window(each_int);
+
+        hash_part -= array_part;
+        auto new_hash_size_log2 = std::max(1u, bit(hash_part) + 1);
 
-        auto hash1 = *hash; // hash deref
+        event.new_array_size_log2 = new_array_size_log2;
+        event.new_hash_size_log2 = new_hash_size_log2;
+        event.new_array_base = new_array_base;
+
+        event.old_layout = event.new_layout = layout;
+        if (adaptive != nullptr) {
+            std::tie(event.new_layout, event.layout_reason) = choose_layout(hash_part, ints - array_part);
+            event.sampled_lookups = adaptive->lookups.exchange(0, std::memory_order_relaxed);
+            event.sampled_misses = adaptive->misses.exchange(0, std::memory_order_relaxed);
+            event.sampled_walks = adaptive->walks.exchange(0, std::memory_order_relaxed);
+            event.sampled_steps = adaptive->steps.exchange(0, std::memory_order_relaxed);
+        }
 
-        for (int i = 0; i < hash_size(); i++) {
-            if (!is_empty(&(*hash)[i])) {
-                hash_part++;
-                if (hash1[i].key->type() == INT) {
-                    push_into_counter(hash1[i].key->item());
-                }
+        if (!observers.empty()) {
+            event.elapsed = std::chrono::steady_clock::now() - start;
+            for (auto &observer: observers)
+                observer->before_resize(event);
+        }
+
+        if (event.new_layout != layout)
+            change_layout(event.new_layout, event.hash_entries);
+
+        auto entries = event.array_entries + event.hash_entries;
+        event.array_entries = resize(new_array_size_log2, new_hash_size_log2, new_array_base);
+        event.hash_entries = entries - event.array_entries;
+
+        if (!observers.empty()) {
+            event.elapsed = std::chrono::steady_clock::now() - start;
+            for (auto &observer: observers)
+                observer->after_resize(event);
+        }
+    }
+
+    /// 在时间轮中登记 value 的过期时间
+    void schedule_expiry(const Key &key, const std::shared_ptr<Value> &value, Clock::time_point deadline) {
+        if (timers == nullptr) {
+            timers = std::make_unique<TimerWheel<Expiry>>();
+            epoch = Clock::now();
+        }
+        // round up, so that the wheel never fires before the deadline
+        auto tick = (deadline - epoch + TTL_TICK - std::chrono::nanoseconds(1)) / TTL_TICK;
+        timers->schedule(std::max<int64_t>(tick, 0), { key, value });
+    }
+
+    /// hash 部分是否快满了，这时开始后台 rehash，赶在插入失败之前
+    [[nodiscard]] bool approaching_capacity() const {
+        if (hash_size_log2 < BACKGROUND_MIN_LOG2 || cache_capacity != 0)
+            return false;
+        if (engine != nullptr)
+            return engine->size() * 4 >= hash_size() * 3;
+        return used * 4 >= hash_size() * 3;
+    }
+
+    /// 冻结现在的 array 与 hash 部分，在后台线程中建立新的 Table
+    void start_rehash() {
+        auto start = std::chrono::steady_clock::now();
+        if (reaper.joinable())
+            reaper.join();
+        rehash = std::make_unique<Rehash>();
+        add_log(CATCH_UP);
+        rehash->budget = hash_size() / 2;
+
+        auto &event = rehash->event;
+        event.old_array_size_log2 = event.new_array_size_log2 = array_size_log2;
+        event.old_hash_size_log2 = event.new_hash_size_log2 = hash_size_log2;
+        event.old_array_base = event.new_array_base = array_base;
+        event.old_layout = event.new_layout = layout;
+        event.background = true;
+        if (!observers.empty()) {
+            event.elapsed = std::chrono::steady_clock::now() - start;
+            for (auto &observer: observers)
+                observer->before_resize(event);
+        }
+
+        auto state = rehash.get();
+        state->worker = std::thread([this, state] {
+            try {
+                state->built = rebuilt(2 * state->budget, state->event);
+            } catch (...) {
+                state->error = std::current_exception();
             }
+            state->ready.store(true, std::memory_order_release);
+        });
+    }
+
+    /// 用冻结的 array 与 hash 部分建立新的 Table，多留出 extra 个 entry 的空间，把冻结部分的统计填进 event。
+    /// 在后台线程中运行，只读取 entry，过期的 entry 照常带过去，由时间轮回收
+    std::unique_ptr<Table> rebuilt(unsigned long extra, ResizeEvent &event) {
+        auto built = std::make_unique<Table>(0, 1, layout);
+        built->array.set_paged(array.is_paged());
+
+        std::vector<Integer> ints;
+        unsigned long total = 0;
+        visit_in(0, slot_count(), [&](const Key &key, std::shared_ptr<Value>&) {
+            if (key.type() == INT)
+                ints.push_back(key.item());
+            total++;
+        });
+        built->reserve(ints, total + extra);
+
+        for (auto i: ints) {
+            if (i >= 1) event.counter[bit(i)]++;
+            if (built->in_array(i)) event.array_entries++;
+        }
+        event.hash_entries = total - event.array_entries;
+
+        // Probing tables that grow while they are filled in slot order pile every key into one
+        // cluster, so the positions are visited in small chunks taken in bit-reversed order.
+        const unsigned CHUNK_LOG2 = 6;
+        auto positions = slot_count();
+        unsigned chunks_log2 = 0;
+        while ((1ul << (chunks_log2 + CHUNK_LOG2)) < positions)
+            chunks_log2++;
+        for (unsigned long c = 0; c < (1ul << chunks_log2); c++) {
+            unsigned long r = 0;
+            for (unsigned b = 0; b < chunks_log2; b++)
+                r |= (c >> b & 1) << (chunks_log2 - 1 - b);
+            auto begin = r << CHUNK_LOG2;
+            if (begin < positions)
+                visit_in(begin, std::min(positions, begin + (1ul << CHUNK_LOG2)),
+                         [&](const Key &key, std::shared_ptr<Value> &value) { built->insert(key, value); });
+        }
+        return built;
+    }
+
+    /// 按顺序把 log 中的修改重放到 table 中
+    static void replay(Table &log, Table &table) {
+        log.for_each([&](const Key &key, std::shared_ptr<Value> &value) {
+            if (value == tombstone())
+                table.erase(key);
+            else
+                table.insert(key, value);
+        });
+    }
+
+    /// 开始一个能容纳 capacity 个修改的 log
+    void add_log(unsigned long capacity) {
+        rehash->logs.push_back(std::make_unique<Table>());
+        rehash->logs.back()->reserve({}, capacity);
+        rehash->capacity = capacity, rehash->filled = 0;
+    }
+
+    /// 后台 rehash 期间的修改只记入最后一个 log，value 为 tombstone() 表示删除
+    void log_change(const Key &key, const std::shared_ptr<Value> &value) {
+        if (rehash->filled == rehash->capacity)
+            add_log(2 * rehash->capacity);
+        rehash->logs.back()->insert(key, value);
+        rehash->logged++, rehash->pending++, rehash->filled++;
+        // once the new table is out of room, wait for it rather than let the logs grow further
+        if (rehash->logged >= rehash->budget)
+            finish_rehash();
+        else if (rehash->ready.load(std::memory_order_acquire))
+            catch_up();
+    }
+
+    /// 后台线程完成了一轮：剩下的 log 足够短时结束 rehash，否则把它交给后台线程，换一个新的 log
+    void catch_up() {
+        rehash->worker.join();
+        if (rehash->error != nullptr || rehash->pending <= CATCH_UP) {
+            finish_rehash();
+            return;
         }
 
-        int new_array_size_log2 = 0, array_part = 0;
-        for (int i = 0, total = 1; i < std::min(MAX_BIT, 31); i++) {
-            total += counter[i];
-            // less half vacancy, 1 << (i + 1) can be a new array-part size
-            // take the maximum from all possible size
-            if (total > (1 << i)) {
-                new_array_size_log2 = i + 1;
-                array_part = total;
+        std::vector<Table*> batch;
+        for (auto i = rehash->replayed; i < rehash->logs.size(); i++)
+            batch.push_back(rehash->logs[i].get());
+        rehash->replayed = rehash->logs.size();
+        add_log(CATCH_UP);
+        rehash->pending = 0;
+        rehash->ready.store(false, std::memory_order_relaxed);
+
+        auto state = rehash.get();
+        state->worker = std::thread([state, batch] {
+            try {
+                for (auto log: batch)
+                    replay(*log, *state->built);
+            } catch (...) {
+                state->error = std::current_exception();
             }
+            state->ready.store(true, std::memory_order_release);
+        });
+    }
+
+    /// 依次访问位置落在 [begin, end) 中的 entry，不检查过期时间，见 for_each_in
+    template<class F>
+    void visit_in(unsigned long begin, unsigned long end, F visit) {
+        for (auto i = begin; i < std::min(end, array_size()); i++) {
+            auto &slot = array[i];
+            if (slot != nullptr && slot->has_value())
+                visit(Key((Integer)(array_base + i)), slot);
         }
 
-        hash_part -= array_part;
-        auto new_hash_size_log2 = std::max(1u, bit(hash_part) + 1);
+        if (end <= array_size())
+            return;
+        begin = std::max(begin, array_size()) - array_size(), end -= array_size();
+
+        if (engine != nullptr) {
+            engine->for_each_in(begin, end, visit);
+            return;
+        }
+
+        for (auto i = begin; i < end; i++) {
+            auto &node = (*hash)[i];
+            if (is_empty(&node))
+                continue;
+            switch (node.type()) {
+                case INT: visit(Key(node.i), node.value); break;
+                case PTR: visit(Key(node.p), node.value); break;
+                default: visit(*node.key, node.value); break;
+            }
+        }
+    }
 
-        resize(new_array_size_log2, new_hash_size_log2);
+    /// 把 Table 恢复为刚创建时的空表，保留布局、缓存容量与监听者
+    void reset() {
+        Table empty(0, 1, layout);
+        empty.array.set_paged(array.is_paged());
+        array.swap(empty.array);
+        std::swap(hash, empty.hash);
+        std::swap(engine, empty.engine);
+        std::swap(vacancy_head, empty.vacancy_head);
+        std::swap(last_free, empty.last_free);
+        std::swap(used, empty.used);
+        array_size_log2 = 0, hash_size_log2 = 1, array_base = 0;
+        timers.reset();
+        if (cache_capacity != 0)
+            dynamic_cast<CompactHashPart*>(engine.get())->set_bound(cache_capacity);
     }
 
     void free(Node* node) {
-        node->key.reset(), node->value.reset();
-        node->next = nullptr, node->vacancy_next = nullptr;
-        if (vacancy_head != nullptr)
-            node->vacancy_next = vacancy_head;
+        node->release();
+        used--;
+        node->next = 0, node->vacancy_next = 0;
+        if (vacancy_head != nullptr) {
+            node->vacancy_next = (int32_t)(vacancy_head - node);
+            vacancy_head->next = (int32_t)(node - vacancy_head);
+        }
         vacancy_head = node;
     }
 
-public:
-    explicit Table(unsigned long array_size_log2 = 0, unsigned long hash_size_log2 = 1):
-        hash_size_log2(hash_size_log2), array_size_log2(array_size_log2),
-        vacancy_head(nullptr), last_free((1 << hash_size_log2) - 1) {
+    /// 把节点 src 中的 entry 移入 hash 部分，这个 key 不能已经在 Table 中
+    void insert_node(Node* src, Hash h) {
+        if (place_node(src, h, [this] { return get_free_pos(); })) {
+            used++;
+            return;
+        }
 
-        array = std::make_shared<std::shared_ptr<Value>*>(new std::shared_ptr<Value>[1 << array_size_log2]);
-        hash = std::make_shared<Node*>(new Node[1 << hash_size_log2]);
+        recompute_size();
+        if (engine != nullptr) {
+            // the adaptive mode moved the hash part to another layout, src keeps its key
+            insert(src->get_key(), src->value);
+            return;
+        }
+        // the key may belong to the array part after resizing
+        if (src->type() == INT && in_array(src->item())) {
+            array_slot(src->item()) = std::move(src->value);
+            return;
+        }
+        insert_node(src, h);
+    }
+
+    /// 把节点 src 中的 entry 放进 hash 部分，主位置被占用时用 free_pos() 取一个空闲节点，
+    /// 取不到时返回 false，hash 部分不变。不修改 used，由调用者计数
+    template<class F>
+    bool place_node(Node* src, Hash h, F free_pos) {
+        auto mp = main_pos(h);
+        if (is_empty(mp)) {
+            unlink_vacancy(mp);
+            mp->take(src);
+            return true;
+        }
+
+        std::optional<Node*> free_node = free_pos();
+        if (!free_node.has_value())
+            return false;
+
+        auto free = free_node.value();
+
+        Node *other = main_pos(mp->hash());
+
+        if (other == mp) {
+            free->take(src);
+            free->link(mp->next_node()), mp->link(free);
+        } else {
+            // mp is not in its main position, move it to the free slot
+            Node *last = other;
+            while (last->next_node() != mp) {
+                last = last->next_node();
+            }
+
+            free->take(mp);
+            free->link(mp->next_node()), last->link(free);
+            mp->take(src);
+        }
+        return true;
+    }
+
+public:
+    explicit Table(unsigned long array_size_log2 = 0, unsigned long hash_size_log2 = 1, Layout layout = CHAINED):
+        vacancy_head(nullptr), array_size_log2(array_size_log2), array_base(0), hash_size_log2(hash_size_log2),
+        last_free((1ul << hash_size_log2) - 1), used(0), layout(layout), cache_capacity(0), background_rehash(false) {
+
+        engine = make_hash_part(layout, hash_size_log2);
+        if (engine == nullptr && hash_size_log2 > MAX_CHAINED_LOG2)
+            throw std::length_error("Table: the CHAINED hash part is limited to 2^31 nodes, use another layout");
+        array = ArrayPart(1ul << array_size_log2);
+        hash = std::make_shared<Node*>(engine == nullptr ? new Node[1ul << hash_size_log2] : nullptr);
     }
 
     ~Table() {
-        if (array.unique())
-            delete [] *array;
+        if (rehash != nullptr && rehash->worker.joinable())
+            rehash->worker.join();
+        if (reaper.joinable())
+            reaper.join();
         if (hash.unique())
             delete [] *hash;
     };
 
-    /// 根据 key 查询，返回对应的 Node 指针
-    std::optional<std::shared_ptr<Value>> query(const std::shared_ptr<Key>& key) {
-        if (key->type() == INT && key->item() < array_size()) {
-            if ((*array)[key->item()] != nullptr)
-                return (*array)[key->item()];
-            else return {};
-        }
+    /// 根据 key 查找 value，不检查是否过期
+    std::optional<std::shared_ptr<Value>> lookup(const Key& key) {
+        auto slot = locate(key);
+        if (slot == nullptr)
+            return {};
+        return *slot;
+    }
 
-        auto mp = main_pos(key);
-        while (!is_empty(mp) && !(*mp->key == *key)) {
-            mp = mp->next;
-        }
-        if (is_empty(mp)) {
+    /// 借用 key 对应的 value：不复制 shared_ptr，不改变引用计数，指针在下一次修改 Table 之前有效。
+    /// 过期的 entry 视为不存在，但不在这里删除，所以多个只读的线程可以同时调用
+    /// （缓存模式除外，查找会记录访问）
+    Value* find(const Key& key) {
+        auto slot = locate(key);
+        if (slot == nullptr || (timers != nullptr && expired(*slot, Clock::now())))
+            return nullptr;
+        return slot->get();
+    }
+
+    /// 根据 key 查询，过期的 entry 在这里被删除
+    std::optional<std::shared_ptr<Value>> query(const Key& key) {
+        auto value = lookup(key);
+        if (timers != nullptr && value.has_value() && expired(*value, Clock::now())) {
+            erase(key);
             return {};
-        } else {
-            return mp->value;
         }
+        return value;
+    }
+
+    std::optional<std::shared_ptr<Value>> query(const std::shared_ptr<Key>& key) {
+        return query(*key);
     }
 
     /// 从 Table 中删除 entry
-    void erase(const std::shared_ptr<Key>& key) {
-        if (key->type() == INT && key->item() < array_size()) {
-            (*array)[key->item()].reset();
+    void erase(const Key& key) {
+        if (rehash != nullptr) {
+            log_change(key, tombstone());
             return;
         }
 
-        Node *mp = main_pos(key), *last = nullptr;
-        while (!is_empty(mp) && !(*mp->key == *key)) {
-            last = mp, mp = mp->next;
+        if (key.type() == INT && in_array(key.item())) {
+            array_slot(key.item()).reset();
+            return;
+        }
+
+        if (engine != nullptr) {
+            engine->erase(key);
+            return;
+        }
+
+        auto h = key.hash();
+        Node *mp = main_pos(h), *last = nullptr;
+        while (!is_empty(mp) && !mp->matches(h, key)) {
+            last = mp, mp = mp->next_node();
         }
         // nothing to erase
-        if (mp == nullptr) {
+        if (is_empty(mp)) {
             return;
         }
         // case #1: both last and mp->next are nullptr. Remove mp directly.
-        if (mp->next == nullptr && last == nullptr) {
+        if (mp->next == 0 && last == nullptr) {
             free(mp);
             return;
         }
         // case #2: only last is nullptr, move mp->next to mp, then release mp->next
         if (last == nullptr) {
-            auto next = mp->next;
-            *mp = *next, free(next);
+            auto next = mp->next_node();
+            mp->release();
+            mp->take(next), mp->link(next->next_node());
+            free(next);
             return;
         }
         // case #3 last is not nullptr, remove mp and update the link
-        last->next = mp->next, free(mp);
+        last->link(mp->next_node()), free(mp);
+    }
+
+    void erase(const std::shared_ptr<Key>& key) {
+        erase(*key);
     }
 
     /// 向 Table 插入 entry
-    void insert(const std::shared_ptr<Key> &key, const std::shared_ptr<Value> &value) {
-        if (key->type() == INT && key->item() < array_size()) {
-            (*array)[key->item()] = value;
+    void insert(const Key& key, const std::shared_ptr<Value> &value) {
+        if (timers != nullptr)
+            expire(EXPIRE_STEP);
+
+        if (background_rehash && rehash == nullptr && approaching_capacity())
+            start_rehash();
+        if (rehash != nullptr) {
+            // a null value erases the key
+            log_change(key, value != nullptr ? value : tombstone());
             return;
         }
 
-        auto mp = main_pos(key);
-        if (is_empty(mp) || *mp->key == *key) {
-            *mp = Node(key, value);
+        if (key.type() == INT && in_array(key.item())) {
+            array_slot(key.item()) = value;
             return;
         }
 
-        auto free_pos = get_free_pos();
-        if (!free_pos.has_value()) {
-            recompute_size();
-            insert(key, value);
+        // a free node is marked by a null value
+        if (value == nullptr) {
+            erase(key);
             return;
         }
 
-        auto free = free_pos.value();
+        if (engine != nullptr) {
+            if (!engine->insert(key, value)) {
+                recompute_size();
+                insert(key, value);
+            }
+            return;
+        }
 
-        if (main_pos(mp->key) == mp) {
-            *free = std::move(Node(key, value));
-            free->next = mp->next, mp->next = free;
-        } else {
-            Node *first = main_pos(mp->key), *last = nullptr;
-            while (first != mp && first) {
-                last = first;
-                first = first->next;
+        auto h = key.hash();
+
+        // the key may already be somewhere in the chain, update it in place
+        auto node = main_pos(h);
+        unsigned long compared = 0;
+        while (!is_empty(node) && (compared++, !node->matches(h, key)))
+            node = node->next_node();
+        if (adaptive != nullptr && Adaptive::sampled(h))
+            adaptive->walked(compared);
+        if (!is_empty(node)) {
+            node->value = value;
+            return;
+        }
+
+        Node fresh;
+        fresh.fill(key, value, h);
+        insert_node(&fresh, h);
+    }
+
+    void insert(const std::shared_ptr<Key> &key, const std::shared_ptr<Value> &value) {
+        insert(*key, value);
+    }
+
+    /// 插入 ttl 之后过期的 entry。过期的 entry 在查询时不可见，它们的空间由 insert 与 expire 逐步回收
+    void insert_with_ttl(const Key& key, Value value, std::chrono::nanoseconds ttl) {
+        // an empty value is an erase, there is nothing to expire
+        if (!value.has_value()) {
+            erase(key);
+            return;
+        }
+        auto deadline = Clock::now() + ttl;
+        std::shared_ptr<Value> entry(new Value(std::move(value)), Expiring{ deadline });
+        insert(key, entry);
+        schedule_expiry(key, entry, deadline);
+    }
+
+    /// 删除至多 budget 个已经到期的 entry，返回删除的个数。代价与到期的 entry 数成正比，
+    /// 可以由事件循环定期调用，Table 本身不是线程安全的
+    unsigned long expire(unsigned long budget = std::numeric_limits<unsigned long>::max()) {
+        if (timers == nullptr)
+            return 0;
+
+        timers->advance((Clock::now() - epoch) / TTL_TICK);
+
+        unsigned long erased = 0;
+        timers->drain(budget, [&](Expiry &&expiry) {
+            auto value = expiry.value.lock();
+            if (value == nullptr)
+                return;
+            auto current = locate(expiry.key);
+            if (current != nullptr && *current == value) {
+                erase(expiry.key);
+                erased++;
             }
+        });
+        return erased;
+    }
+
+    /// 遍历用的位置个数：先是 array 部分的每个位置，然后是 hash 部分的 slot。
+    /// [0, slot_count()) 可以切成若干段，由不同的线程分别调用 for_each_in，
+    /// 后台 rehash 期间的修改不在其中，需要先调用 finish_rehash
+    [[nodiscard]] unsigned long slot_count() const {
+        return array_size() + (engine != nullptr ? engine->slot_count() : hash_size());
+    }
+
+    /// 依次访问每个 entry，f 的参数为 (const Key&, std::shared_ptr<Value>&)，过期的 entry 被跳过。
+    /// 访问期间不能修改 Table
+    template<class F>
+    void for_each(F f) {
+        finish_rehash();
+        for_each_in(0, slot_count(), f);
+    }
 
-            assert(last != nullptr);
+    /// 依次访问位置落在 [begin, end) 中的 entry，见 slot_count()
+    template<class F>
+    void for_each_in(unsigned long begin, unsigned long end, F f) {
+        auto now = timers != nullptr ? Clock::now() : Clock::time_point();
+        visit_in(begin, end, [&](const Key &key, std::shared_ptr<Value> &value) {
+            if (timers == nullptr || !expired(value, now))
+                f(key, value);
+        });
+    }
 
-            *free = std::move(Node(last->key, last->value));
-            free->next = mp->next, last->next = free;
-            *mp = std::move(Node(key, value));
+    /// 按从小到大的顺序访问 [lo, hi] 中的 INT key，f 的参数为 (Integer, std::shared_ptr<Value>&)，
+    /// 只有 RADIX 布局支持
+    template<class F>
+    void scan(Integer lo, Integer hi, F f) {
+        auto radix = dynamic_cast<RadixHashPart*>(engine.get());
+        if (radix == nullptr)
+            throw std::logic_error("Table: scan() requires the RADIX layout");
+        finish_rehash();
+
+        // integer keys below the array part, in it, and above it
+        auto last = (Integer)((unsigned long)array_base + array_size() - 1);
+
+        if (lo < array_base)
+            radix->scan(lo, std::min(hi, array_base - 1), f);
+
+        for (auto i = std::max(lo, array_base); i <= std::min(hi, last); i++) {
+            auto &slot = array_slot(i);
+            if (slot != nullptr && slot->has_value())
+                f(i, slot);
+            if (i == last) break;
         }
+
+        if (hi > last)
+            radix->scan(std::max(lo, last + 1), hi, f);
+    }
+
+    /// 一次性分配好空间，之后插入这些 entry 不会再 resize。keys 是所有将要保存的 INT key，顺序不限，
+    /// total 是 entry 的总数，都包括 Table 中已有的 entry
+    void reserve(const std::vector<Integer> &keys, unsigned long total) {
+        finish_rehash();
+        auto [new_array_size_log2, new_array_base, array_part] = densest_window([&](const std::function<void(Integer)> &f) {
+            for (auto i: keys)
+                f(i);
+        });
+        auto new_hash_size_log2 = std::max(1u, bit(std::max(1ul, total - array_part)) + 1);
+        resize(new_array_size_log2, new_hash_size_log2, new_array_base);
+    }
+
+    /// 把 sources 中的 entry 用 threads 个线程移入这个 Table，之后 sources 为空。Table 必须是空的，并已用
+    /// reserve 按全部 entry 分配好空间，各个 source 之间没有相同的 key。array 部分的 key 直接写到各自的位置；
+    /// CHAINED 的 hash 部分按主位置切成 threads 段，每个线程只在自己的段内取空闲节点、调整链，
+    /// 段内放不下的 entry 最后在当前线程中插入。其他布局的 hash 部分不能分段写入，仍在当前线程中逐个插入
+    void fill(std::vector<std::unique_ptr<Table>> &sources, unsigned threads) {
+        finish_rehash();
+        using Entry = std::pair<Key, std::shared_ptr<Value>>;
+        auto segments = (unsigned)std::max(1ul, std::min<unsigned long>(threads, engine != nullptr ? 1 : hash_size()));
+        auto parallel = [&](unsigned long tasks, const std::function<void(unsigned long)> &f) {
+            std::atomic<unsigned long> next{ 0 };
+            auto work = [&] {
+                for (unsigned long t; (t = next++) < tasks;)
+                    f(t);
+            };
+            std::vector<std::thread> workers;
+            for (unsigned i = 1; i < std::min<unsigned long>(std::max(1u, threads), tasks); i++)
+                workers.emplace_back(work);
+            work();
+            for (auto &worker: workers)
+                worker.join();
+        };
+
+        auto segment_of = [&](const Key &key) {
+            return engine != nullptr ? 0 : (key.hash() & (hash_size() - 1)) * segments >> hash_size_log2;
+        };
+
+        // buckets[s][t]: the entries of source s whose main position lies in segment t
+        std::vector<std::vector<std::vector<Entry>>> buckets(sources.size(), std::vector<std::vector<Entry>>(segments));
+        parallel(sources.size(), [&](unsigned long s) {
+            sources[s]->for_each([&](const Key &key, std::shared_ptr<Value> &value) {
+                // Distinct keys never share an array slot. The values are copied: a slot whose value
+                // is moved out counts as free, and its key would never be released.
+                if (key.type() == INT && in_array(key.item()))
+                    array_slot(key.item()) = value;
+                else
+                    buckets[s][segment_of(key)].emplace_back(key, value);
+            });
+            sources[s].reset();
+        });
+
+        // each segment takes free nodes from its own top down, chains never leave the segment
+        std::vector<std::vector<Entry>> left(segments);
+        std::vector<unsigned long> placed(segments);
+        if (engine == nullptr) parallel(segments, [&](unsigned long t) {
+            // the positions p with p * segments / hash_size() == t
+            auto lo = (t * hash_size() + segments - 1) / segments, free = ((t + 1) * hash_size() + segments - 1) / segments;
+            auto free_pos = [&]() -> std::optional<Node*> {
+                while (free > lo)
+                    if (is_empty(&(*hash)[--free]))
+                        return &(*hash)[free];
+                return {};
+            };
+            for (auto &bucket: buckets)
+                for (auto &entry: bucket[t]) {
+                    Node fresh;
+                    fresh.fill(entry.first, entry.second, entry.first.hash());
+                    if (place_node(&fresh, entry.first.hash(), free_pos))
+                        placed[t]++;
+                    else
+                        left[t].push_back(std::move(entry));
+                }
+        });
+        for (auto count: placed)
+            used += count;
+
+        // what the segments had no room for, and the whole hash part of the other layouts
+        for (auto &entries: left)
+            for (auto &[key, value]: entries)
+                insert(key, value);
+        if (engine != nullptr)
+            for (auto &bucket: buckets)
+                for (auto &[key, value]: bucket[0])
+                    insert(key, value);
+    }
+
+    /// hash 为 h 的 key 在 n 个分区中的编号，高位参与选择，与 hash 部分的下标无关
+    static unsigned partition_of(Hash h, unsigned n) {
+        return (unsigned)(((h * 0x9E3779B97F4A7C15ull) >> 32) * n >> 32);
+    }
+
+    /// 把所有 entry 分到 n 个新的 Table 中，之后这个 Table 为空。新 Table 使用相同的布局，
+    /// 按各自的 entry 一次分配好大小，插入时不会 resize；TTL entry 保留原来的过期时间。
+    /// BY_RANGE 时第 p 个 Table 中的 INT key 都小于第 p + 1 个中的，array 部分按区间整段搬走。
+    /// 给出 pool 时各分区在线程池中并行地建立
+    std::vector<std::unique_ptr<Table>> partition(unsigned n, Partitioning policy = BY_HASH, ThreadPool* pool = nullptr) {
+        n = std::max(1u, n);
+        finish_rehash();
+        auto run = [&](unsigned long tasks, const std::function<void(unsigned long)> &f) {
+            if (pool != nullptr)
+                pool->parallel_for(tasks, f);
+            else for (unsigned long t = 0; t < tasks; t++)
+                f(t);
+        };
+
+        auto now = timers != nullptr ? Clock::now() : Clock::time_point();
+        auto live = [&](const std::shared_ptr<Value> &slot) {
+            return slot != nullptr && slot->has_value() && (timers == nullptr || !expired(slot, now));
+        };
+
+        // BY_RANGE: bounds[p - 1] is the smallest INT key of partition p
+        std::vector<Integer> bounds;
+        if (policy == BY_RANGE) {
+            std::vector<Integer> keys;
+            for (unsigned long i = 0; i < array_size(); i++)
+                if (live(array[i]))
+                    keys.push_back((Integer)(array_base + i));
+            auto sorted = keys.size();
+            for_each_in(array_size(), slot_count(), [&](const Key &key, std::shared_ptr<Value>&) {
+                if (key.type() == INT)
+                    keys.push_back(key.item());
+            });
+            std::sort(keys.begin() + sorted, keys.end());
+            std::inplace_merge(keys.begin(), keys.begin() + sorted, keys.end());
+            if (!keys.empty())
+                for (unsigned p = 1; p < n; p++)
+                    bounds.push_back(keys[keys.size() * p / n]);
+        }
+
+        auto destination = [&](const Key &key) -> unsigned {
+            if (policy == BY_RANGE && key.type() == INT)
+                return std::upper_bound(bounds.begin(), bounds.end(), key.item()) - bounds.begin();
+            return partition_of(key.hash(), n);
+        };
+
+        // the array positions [slices[p], slices[p + 1]) belong to partition p
+        std::vector<unsigned long> slices(n + 1, 0);
+        if (policy == BY_RANGE) {
+            for (unsigned p = 1; p < n; p++) {
+                auto lo = bounds.empty() ? array_base : bounds[p - 1];
+                slices[p] = lo <= array_base ? 0 : std::min(array_size(), (unsigned long)lo - (unsigned long)array_base);
+            }
+            slices[n] = array_size();
+        }
+
+        // route everything else by chunks of positions, every chunk keeps its own buckets
+        using Bucket = std::vector<std::pair<Key, std::shared_ptr<Value>>>;
+        auto first = policy == BY_RANGE ? array_size() : 0;
+        auto positions = slot_count() - first;
+        auto chunks = pool != nullptr ? std::max(1ul, std::min<unsigned long>(pool->size() * 8, positions >> 14)) : 1ul;
+        std::vector<std::vector<Bucket>> buckets(chunks, std::vector<Bucket>(n));
+        run(chunks, [&](unsigned long c) {
+            for_each_in(first + positions * c / chunks, first + positions * (c + 1) / chunks,
+                        [&](const Key &key, std::shared_ptr<Value> &value) {
+                buckets[c][destination(key)].emplace_back(key, value);
+            });
+        });
+
+        std::vector<std::unique_ptr<Table>> parts(n);
+        run(n, [&](unsigned long p) {
+            auto &part = *(parts[p] = std::make_unique<Table>(0, 1, layout));
+            part.array.set_paged(array.is_paged());
+
+            std::vector<Integer> ints;
+            unsigned long total = 0;
+            for (auto i = slices[p]; i < slices[p + 1]; i++)
+                if (live(array[i]))
+                    ints.push_back((Integer)(array_base + i)), total++;
+            for (auto &chunk: buckets)
+                for (auto &[key, value]: chunk[p]) {
+                    if (key.type() == INT)
+                        ints.push_back(key.item());
+                    total++;
+                }
+            part.reserve(ints, total);
+
+            auto track = [&](const Key &key, const std::shared_ptr<Value> &value) {
+                if (timers == nullptr)
+                    return;
+                if (auto expiring = std::get_deleter<Expiring>(value))
+                    part.schedule_expiry(key, value, expiring->deadline);
+            };
+
+            auto begin = slices[p], end = slices[p + 1];
+            auto low = (Integer)(array_base + begin), high = (Integer)(array_base + end - 1);
+            if (begin < end && timers == nullptr && part.in_array(low) && part.in_array(high)) {
+                // the whole slice lands in the new array part, no lookups needed
+                for (auto i = begin; i < end; i++)
+                    part.array[(unsigned long)low - (unsigned long)part.array_base + (i - begin)] = std::move(array[i]);
+            } else for (auto i = begin; i < end; i++) {
+                auto &slot = array[i];
+                if (!live(slot))
+                    continue;
+                auto key = Key((Integer)(array_base + i));
+                track(key, slot);
+                part.insert(key, slot);
+            }
+
+            for (auto &chunk: buckets) {
+                for (auto &[key, value]: chunk[p]) {
+                    track(key, value);
+                    part.insert(key, value);
+                }
+                Bucket().swap(chunk[p]);
+            }
+        });
+
+        reset();
+        return parts;
+    }
+
+    /// 把 Table 变为最多保存 capacity 个 entry 的缓存，插入新 key 时按 CLOCK 淘汰旧 entry。
+    /// 访问记录保存在 hash 部分的 entry 中，get 与 put 都只需一次查找。只有 COMPACT 布局支持，
+    /// capacity 为 0 时恢复为普通的 Table
+    void set_capacity(unsigned long capacity) {
+        auto compact = dynamic_cast<CompactHashPart*>(engine.get());
+        if (compact == nullptr)
+            throw std::logic_error("Table: the cache mode requires the COMPACT layout");
+        finish_rehash();
+
+        if (cache_capacity == 0 && capacity != 0) {
+            // move the array part into the hash part
+            auto entries = engine->size() + array_size();
+            hash_size_log2 = std::max(hash_size_log2, (unsigned long)bit(entries) + 1);
+            engine->resize(hash_size_log2);
+            for (unsigned long i = 0; i < array_size(); i++)
+                if (array[i] != nullptr && array[i]->has_value())
+                    engine->insert(Key((Integer)(array_base + i)), array[i]);
+
+            array = ArrayPart(1, array.is_paged());
+            array_size_log2 = 0, array_base = 0;
+        }
+
+        cache_capacity = capacity;
+        compact->set_bound(capacity);
+    }
+
+    /// 使用分页的 array 部分：由 2^16 个位置的页组成，扩大时只添加页，缩小时释放页，
+    /// 不会为了 resize 同时占用新旧两块内存。下标多一次查页目录，默认使用连续的一块内存
+    void set_paged_array(bool enabled) {
+        finish_rehash();
+        array.set_paged(enabled);
+    }
+
+    /// array 部分占用的字节数。它不经过 operator new 分配，统计内存时需要单独加上
+    [[nodiscard]] unsigned long array_bytes() const {
+        return array.allocated_bytes();
+    }
+
+    /// 开启后，Table 抽样统计查找的落空率与 CHAINED 的链长，在每次前台 resize 时结合 hash 部分中
+    /// key 的类型与个数重新选择 hash 部分的布局，规则见 choose_layout。每次的决定与依据通过
+    /// ResizeEvent 交给监听者记录。布局可能变为 RADIX 以外的布局，之后 scan() 会失败；缓存模式与
+    /// 后台 rehash 不改变布局
+    void set_adaptive_layout(bool enabled) {
+        if (!enabled)
+            adaptive.reset();
+        else if (adaptive == nullptr)
+            adaptive = std::make_unique<Adaptive>();
+    }
+
+    /// hash 部分现在的布局，自适应模式下会改变
+    [[nodiscard]] Layout get_layout() const {
+        return layout;
+    }
+
+    /// 开启后，hash 部分快满时在后台线程中建立更大的 array 与 hash 部分，期间的修改记入 log，
+    /// 建好后重放 log 并交换，插入不再在前台 resize。后台线程只读冻结的部分，前台照常读写，
+    /// Table 对调用者来说仍然不是线程安全的。小的 Table 与缓存模式仍在前台 resize。
+    /// 监听者在冻结时收到 before_resize，在交换后收到 after_resize，见 ResizeEvent::background
+    void set_background_rehash(bool enabled) {
+        background_rehash = enabled;
+        if (!enabled)
+            finish_rehash();
+    }
+
+    /// 等待进行中的后台 rehash，重放剩下的修改并换上新的 array 与 hash 部分，没有进行中的 rehash 时直接返回
+    void finish_rehash() {
+        if (rehash == nullptr)
+            return;
+        auto start = std::chrono::steady_clock::now();
+        // from here on changes go to the table itself again
+        auto state = std::move(rehash);
+        if (state->worker.joinable())
+            state->worker.join();
+
+        if (state->error != nullptr) {
+            // the frozen parts are intact, bring them up to date instead
+            for (auto &log: state->logs)
+                replay(*log, *this);
+            std::rethrow_exception(state->error);
+        }
+
+        auto &built = *state->built;
+        for (auto i = state->replayed; i < state->logs.size(); i++)
+            replay(*state->logs[i], built);
+
+        array.swap(built.array);
+        std::swap(hash, built.hash);
+        std::swap(engine, built.engine);
+        std::swap(vacancy_head, built.vacancy_head);
+        std::swap(last_free, built.last_free);
+        std::swap(used, built.used);
+        std::swap(array_size_log2, built.array_size_log2);
+        std::swap(hash_size_log2, built.hash_size_log2);
+        std::swap(array_base, built.array_base);
+
+        if (!observers.empty()) {
+            auto &event = state->event;
+            event.new_array_size_log2 = array_size_log2;
+            event.new_hash_size_log2 = hash_size_log2;
+            event.new_array_base = array_base;
+            event.elapsed = std::chrono::steady_clock::now() - start;
+            for (auto &observer: observers)
+                observer->after_resize(event);
+        }
+
+        // the old parts are freed in the background too
+        if (reaper.joinable())
+            reaper.join();
+        reaper = std::thread([retired = std::move(state)] {});
+    }
+
+    /// 注册 resize 监听者，每次 resize 前后都会被调用
+    void add_observer(const std::shared_ptr<IResizeObserver> &observer) {
+        observers.push_back(observer);
+    }
+
+    void remove_observer(const std::shared_ptr<IResizeObserver> &observer) {
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
     }
 
     NodeReference operator [] (const Key& key) {
-        return { std::make_shared<Key>(key), this };
+        return { key, this };
     }
 };
 
@@ -0,0 +1,94 @@
+#ifndef TABLE_TAGGEDHASHPART_H
+#define TABLE_TAGGEDHASHPART_H
+
+#include "HashPart.h"
+
+/// 按 key 的 tag 分成几个子表的 hash 部分，每次操作只在开头根据 tag 分派一次，
+/// 子表内部的比较不再经过 Key::operator== 的 switch。字符串子表不驻留字符串：查找用的 key 要先在共享的
+/// 字符串池中查一次才能按指针比较，这次查找与直接比较缓存的 hash 代价相当，共享的池还要给并发的读者加锁
+class TaggedHashPart: public IHashPart {
+private:
+    ProbingPart<IntTraits> ints;
+    ProbingPart<PtrTraits> ptrs;
+    ProbingPart<StrTraits> strs;
+    ProbingPart<GenericTraits> others; // NUM and H
+
+    unsigned long capacity;
+
+    template<class F>
+    auto dispatch(const Key &key, F f) {
+        switch (key.type()) {
+            case INT: return f(ints);
+            case PTR: return f(ptrs);
+            case STR: return f(strs);
+            default: return f(others);
+        }
+    }
+
+public:
+    explicit TaggedHashPart(unsigned long hash_size_log2): capacity(1ul << hash_size_log2) {}
+
+    std::shared_ptr<Value>* find(const Key &key) override {
+        return dispatch(key, [&](auto &part) { return part.find(key, key.hash()); });
+    }
+
+    bool insert(const Key &key, const std::shared_ptr<Value> &value) override {
+        return dispatch(key, [&](auto &part) {
+            auto h = key.hash();
+            auto slot = part.find(key, h);
+            if (slot != nullptr) {
+                *slot = value;
+                return true;
+            }
+            if (size() >= capacity)
+                return false;
+            part.insert(key, h, value);
+            return true;
+        });
+    }
+
+    void erase(const Key &key) override {
+        dispatch(key, [&](auto &part) { part.erase(key, key.hash()); });
+    }
+
+    [[nodiscard]] unsigned long size() const override {
+        return ints.size() + ptrs.size() + strs.size() + others.size();
+    }
+
+    [[nodiscard]] unsigned long slot_count() const override {
+        return ints.capacity() + ptrs.capacity() + strs.capacity() + others.capacity();
+    }
+
+    /// 四个子表的 slot 依次排开
+    void for_each_in(unsigned long begin, unsigned long end, const std::function<void(const Key&, std::shared_ptr<Value>&)> &f) override {
+        unsigned long offset = 0;
+        auto visit = [&](auto &part) {
+            using Traits = typename std::decay_t<decltype(part)>::KeyTraits;
+            auto lo = std::max(begin, offset), hi = std::min(end, offset + part.capacity());
+            if (lo < hi)
+                part.for_each(lo - offset, hi - offset, [&](auto &slot) { f(Traits::key(slot.key), slot.value); });
+            offset += part.capacity();
+        };
+        visit(ints), visit(ptrs), visit(strs), visit(others);
+    }
+
+    void for_each_int(const std::function<void(Integer)> &f) override {
+        ints.for_each([&](auto &slot) { f(slot.key); });
+    }
+
+    void extract_ints(Integer base, unsigned long size, const std::function<void(Integer, std::shared_ptr<Value>&&)> &f) override {
+        ints.remove_if([&](auto &slot) {
+            if ((unsigned long)slot.key - (unsigned long)base >= size)
+                return false;
+            f(slot.key, std::move(slot.value));
+            return true;
+        });
+    }
+
+    void resize(unsigned long hash_size_log2) override {
+        capacity = 1ul << hash_size_log2;
+        ints.shrink(), ptrs.shrink(), strs.shrink(), others.shrink();
+    }
+};
+
+#endif //TABLE_TAGGEDHASHPART_H
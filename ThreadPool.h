@@ -0,0 +1,147 @@
+#ifndef TABLE_THREADPOOL_H
+#define TABLE_THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <algorithm>
+
+/// work-stealing 线程池。每个线程有自己的任务队列，从队尾取自己的任务，
+/// 自己的队列空了就从别的队列头部偷任务；等待结果的线程也会帮忙执行任务
+class ThreadPool {
+private:
+    using Task = std::function<void()>;
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker thread
+    std::vector<std::thread> threads;
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<unsigned long> pending{ 0 }; // tasks in the queues, counted before they are pushed
+    bool stopping = false; // guarded by sleep_lock
+
+    bool pop(unsigned self, Task &task) {
+        auto &queue = *queues[self];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        pending--;
+        return true;
+    }
+
+    /// 从 self 之后的队列开始找，避免所有线程都去偷同一个队列
+    bool steal(unsigned self, Task &task) {
+        for (unsigned i = 1; i <= queues.size(); i++) {
+            auto &queue = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.tasks.empty())
+                continue;
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            pending--;
+            return true;
+        }
+        return false;
+    }
+
+    void work(unsigned self) {
+        Task task;
+        while (true) {
+            if (pop(self, task) || steal(self, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [&] { return stopping || pending > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, threads);
+        for (unsigned i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < threads; i++)
+            this->threads.emplace_back(&ThreadPool::work, this, i);
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread: threads)
+            thread.join();
+    }
+
+    /// 进程共享的线程池，线程数等于 CPU 核数
+    static ThreadPool& global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    [[nodiscard]] unsigned size() const {
+        return threads.size();
+    }
+
+    /// 并行地执行 f(0), f(1), ..., f(n - 1)，全部完成后返回。f 抛出的第一个异常在这里重新抛出。
+    /// 可以在任务中嵌套调用
+    void parallel_for(unsigned long n, const std::function<void(unsigned long)> &f) {
+        std::atomic<unsigned long> left{ n };
+        std::exception_ptr error;
+        std::mutex error_lock;
+
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            pending += n;
+        }
+        for (unsigned long i = 0; i < n; i++) {
+            auto &queue = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.tasks.emplace_back([&, i] {
+                try {
+                    f(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(error_lock);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                left--;
+            });
+        }
+        wake.notify_all();
+
+        // help instead of blocking, this also keeps nested calls from deadlocking
+        Task task;
+        while (left > 0) {
+            if (steal(0, task))
+                task();
+            else
+                std::this_thread::yield();
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+#endif //TABLE_THREADPOOL_H
@@ -0,0 +1,117 @@
+#ifndef TABLE_TIMERWHEEL_H
+#define TABLE_TIMERWHEEL_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+/// 分层时间轮。每层 64 个槽，第 l 层的一个槽对应 64^l 个 tick，timer 随时间推进逐层下移，
+/// 到期后进入待处理队列。每层用一个 64 位的位图记录非空的槽，推进时直接跳过空槽，
+/// 所以推进的代价只与经过的 timer 个数有关，与经过的 tick 数无关
+template<class T>
+class TimerWheel {
+private:
+    struct Timer {
+        uint64_t deadline;
+        T payload;
+    };
+
+    static const unsigned BITS = 6;
+    static const unsigned SLOTS = 1u << BITS;
+    static const unsigned LEVELS = (64 + BITS - 1) / BITS; // enough for any 64-bit tick
+
+    // A timer at level l has the same ticks as `now` above the l-th group of bits and a larger
+    // l-th group, which selects its slot.
+    std::vector<Timer> slots[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS];
+    uint64_t now;
+
+    std::deque<Timer> due;
+    unsigned long count; // timers in the wheel and in due
+
+    void place(Timer &&timer) {
+        if (timer.deadline <= now) {
+            due.push_back(std::move(timer));
+            return;
+        }
+        auto level = (63 - __builtin_clzll(timer.deadline ^ now)) / BITS;
+        auto slot = (timer.deadline >> (BITS * level)) & (SLOTS - 1);
+        slots[level][slot].push_back(std::move(timer));
+        occupied[level] |= 1ull << slot;
+    }
+
+    /// 最早的非空槽开始的 tick，没有 timer 时返回 UINT64_MAX
+    [[nodiscard]] uint64_t next_event() const {
+        uint64_t next = UINT64_MAX;
+        for (unsigned level = 0; level < LEVELS; level++) {
+            if (occupied[level] == 0)
+                continue;
+            auto shift = BITS * level;
+            auto high = shift + BITS >= 64 ? 0 : now >> (shift + BITS) << (shift + BITS);
+            next = std::min(next, high | (uint64_t)__builtin_ctzll(occupied[level]) << shift);
+        }
+        return next;
+    }
+
+public:
+    TimerWheel(): occupied(), now(0), count(0) {}
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator = (const TimerWheel&) = delete;
+
+    [[nodiscard]] uint64_t current() const {
+        return now;
+    }
+
+    [[nodiscard]] unsigned long size() const {
+        return count;
+    }
+
+    /// 在 deadline 这个 tick 到期，已经过去的 deadline 立即到期
+    void schedule(uint64_t deadline, T payload) {
+        place({ deadline, std::move(payload) });
+        count++;
+    }
+
+    /// 时间推进到 to，到期的 timer 移入待处理队列
+    void advance(uint64_t to) {
+        while (now < to) {
+            auto next = next_event();
+            if (next > to) {
+                now = to;
+                return;
+            }
+            now = next;
+
+            // slots starting at `now` are pushed one level down, from the top so that a timer may
+            // move down several levels at once
+            for (unsigned level = LEVELS; level-- > 0;) {
+                auto shift = BITS * level;
+                auto slot = (now >> shift) & (SLOTS - 1);
+                if (!(occupied[level] >> slot & 1) || (now & ((1ull << shift) - 1)) != 0)
+                    continue;
+                std::vector<Timer> timers;
+                timers.swap(slots[level][slot]);
+                occupied[level] &= ~(1ull << slot);
+                for (auto &timer: timers)
+                    place(std::move(timer));
+            }
+        }
+    }
+
+    /// 把至多 budget 个到期的 timer 交给 f，返回处理的个数
+    template<class F>
+    unsigned long drain(unsigned long budget, F f) {
+        unsigned long done = 0;
+        while (done < budget && !due.empty()) {
+            auto payload = std::move(due.front().payload);
+            due.pop_front();
+            count--, done++;
+            f(std::move(payload));
+        }
+        return done;
+    }
+};
+
+#endif //TABLE_TIMERWHEEL_H
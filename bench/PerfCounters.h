@@ -0,0 +1,113 @@
+#ifndef TABLE_PERFCOUNTERS_H
+#define TABLE_PERFCOUNTERS_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/// 用 perf_event_open 读取当前线程的硬件计数器。每个事件单独打开，内核或虚拟机不支持的事件被跳过，
+/// 一个都打不开时 available() 为 false，测试照常进行，只是不报告计数。
+/// 事件多于硬件计数器时内核轮流计数，读数按实际计数的时间比例放大
+class PerfCounters {
+private:
+    struct Event {
+        const char* name;
+        uint32_t type;
+        uint64_t config;
+        int fd = -1;
+        double value = 0; // of the last start()/stop() interval
+    };
+
+    std::vector<Event> events;
+    std::string error; // why the first event that failed couldn't be opened
+
+    static uint64_t cache(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | op << 8 | result << 16;
+    }
+
+    static int open(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+public:
+    PerfCounters() {
+        Event wanted[] = {
+            { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { "l1d-misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { "llc-misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { "dtlb-misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        };
+        for (auto &event: wanted) {
+            event.fd = open(event.type, event.config);
+            if (event.fd >= 0)
+                events.push_back(event);
+            else if (error.empty())
+                error = std::string(event.name) + ": " + strerror(errno);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator = (const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        for (auto &event: events)
+            close(event.fd);
+    }
+
+    [[nodiscard]] bool available() const {
+        return !events.empty();
+    }
+
+    /// 第一个打不开的事件与原因，例如 perf_event_paranoid 禁止访问，或者在没有 PMU 的虚拟机中
+    [[nodiscard]] const std::string& unavailable_reason() const {
+        return error;
+    }
+
+    void start() {
+        for (auto &event: events) {
+            ioctl(event.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(event.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        for (auto &event: events)
+            ioctl(event.fd, PERF_EVENT_IOC_DISABLE, 0);
+        for (auto &event: events) {
+            uint64_t data[3]; // value, time enabled, time running
+            event.value = -1;
+            if (read(event.fd, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+                continue;
+            event.value = (double)data[0] * data[1] / data[2];
+        }
+    }
+
+    /// 上一次 start() 与 stop() 之间每次操作的计数，格式为 "\tname/op=value"，打不开或读不到的事件不输出
+    [[nodiscard]] std::string per_operation(unsigned long operations) const {
+        std::ostringstream result;
+        for (auto &event: events)
+            if (event.value >= 0 && operations > 0)
+                result << '\t' << event.name << "/op=" << event.value / operations;
+        return result.str();
+    }
+};
+
+#endif //TABLE_PERFCOUNTERS_H
@@ -0,0 +1,208 @@
+#ifndef TABLE_WORKLOAD_H
+#define TABLE_WORKLOAD_H
+
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include "HashWrapper.h"
+#include "Zipf.h"
+
+/// 一次操作的种类，见 Workload::mix
+enum Op {
+    READ,
+    WRITE,
+    ERASE,
+};
+
+struct Operation {
+    Op op;
+    unsigned long key; // an index into the key set the operations were generated for
+};
+
+/// 基准测试用的 key 序列与操作序列。相同的参数与 seed 总是生成相同的序列，
+/// 一次测试的结果可以用 seed 重现
+class Workload {
+private:
+    static const uint64_t SCATTER = 0xD6E8FEB86659FD93ull; // spreads ranks over the integers, odd so it's a bijection
+
+    /// x 在模 2^64 下的乘法逆元，x 为奇数。牛顿迭代每次让正确的位数翻倍
+    static uint64_t inverse(uint64_t x) {
+        uint64_t y = x; // correct to 3 bits, since x * x = 1 mod 8
+        for (int i = 0; i < 5; i++)
+            y *= 2 - x * y;
+        return y;
+    }
+
+    /// seed 相同的不同生成器使用不同的随机数流，否则同一个 seed 生成的 key 与操作会互相关联
+    static std::mt19937_64 engine(uint64_t seed, unsigned stream) {
+        std::seed_seq seq{ (uint32_t)seed, (uint32_t)(seed >> 32), stream };
+        return std::mt19937_64(seq);
+    }
+
+    static std::string hex(std::mt19937_64 &rng, unsigned digits) {
+        static const char DIGITS[] = "0123456789abcdef";
+        std::string s(digits, '0');
+        for (auto &c: s)
+            c = DIGITS[rng() & 15];
+        return s;
+    }
+
+public:
+    /// 哪一部分 hash 位决定 hash 部分的位置：CHAINED 取低位，其余布局取乘以黄金分割常数后的高位
+    enum Bucketing {
+        LOW_BITS,
+        FIBONACCI,
+    };
+
+    /// n 个 [0, range) 中均匀分布的整数，可能重复
+    static std::vector<Integer> uniform(unsigned long n, uint64_t range, uint64_t seed) {
+        auto rng = engine(seed, 1);
+        std::uniform_int_distribution<uint64_t> dist(0, range - 1);
+        std::vector<Integer> keys(n);
+        for (auto &key: keys)
+            key = (Integer)dist(rng);
+        return keys;
+    }
+
+    /// n 个 [0, keys) 中的排名，服从参数为 s 的 Zipf 分布，排名 0 最常见
+    static std::vector<unsigned long> zipf_ranks(unsigned long n, unsigned long keys, double s, uint64_t seed) {
+        auto rng = engine(seed, 2);
+        Zipf dist(keys, s);
+        std::vector<unsigned long> ranks(n);
+        for (auto &rank: ranks)
+            rank = dist(rng);
+        return ranks;
+    }
+
+    /// n 次从 keys 个 key 中按 Zipf 分布取值，排名为 r 的 key 是 scatter(r)，可能重复
+    static std::vector<Integer> zipf(unsigned long n, unsigned long keys, double s, uint64_t seed) {
+        auto ranks = zipf_ranks(n, keys, s, seed);
+        std::vector<Integer> result(n);
+        for (unsigned long i = 0; i < n; i++)
+            result[i] = scatter(ranks[i]);
+        return result;
+    }
+
+    /// 排名为 rank 的非负整数 key，相邻的排名被打散到整个整数范围
+    static Integer scatter(unsigned long rank) {
+        return (Integer)(rank * SCATTER >> 1);
+    }
+
+    /// start, start + 1, ..., start + n - 1
+    static std::vector<Integer> sequential(unsigned long n, Integer start = 0) {
+        return strided(n, 1, start);
+    }
+
+    /// start, start + stride, ..., 间隔大于 2 时没有 key 能进入 array 部分
+    static std::vector<Integer> strided(unsigned long n, Integer stride, Integer start = 0) {
+        std::vector<Integer> keys(n);
+        for (unsigned long i = 0; i < n; i++)
+            keys[i] = start + (Integer)i * stride;
+        return keys;
+    }
+
+    /// n 个整数，由长度为 run 的连续段组成，各段的起点随机，顺序打乱。
+    /// 段内是稠密的，段与段之间很稀疏，整体上没有一个窗口能过半
+    static std::vector<Integer> clustered(unsigned long n, unsigned long run, uint64_t seed) {
+        auto rng = engine(seed, 3);
+        std::vector<Integer> keys;
+        keys.reserve(n);
+        while (keys.size() < n) {
+            // 40-bit random starts, runs overlap with negligible probability
+            auto start = (Integer)(rng() >> 24);
+            for (unsigned long i = 0; i < run && keys.size() < n; i++)
+                keys.push_back(start + (Integer)i);
+        }
+        std::shuffle(keys.begin(), keys.end(), rng);
+        return keys;
+    }
+
+    /// n 个形如 https://host/segment/.../id?ref=... 的 URL，可能重复的概率可以忽略
+    static std::vector<std::string> urls(unsigned long n, uint64_t seed) {
+        static const char* HOSTS[] = { "example.com", "cdn.example.net", "api.shop.io", "news.site.org", "static.img.host" };
+        static const char* SEGMENTS[] = { "users", "items", "v2", "search", "assets", "blog", "2024", "en", "products", "media" };
+        auto rng = engine(seed, 4);
+        std::vector<std::string> result(n);
+        for (auto &url: result) {
+            url = "https://";
+            url += HOSTS[rng() % 5];
+            for (auto depth = 1 + rng() % 4; depth > 0; depth--)
+                url += '/', url += SEGMENTS[rng() % 10];
+            url += '/' + std::to_string(rng() % 100000000);
+            if (rng() & 1)
+                url += "?ref=" + hex(rng, 8);
+        }
+        return result;
+    }
+
+    /// n 个随机的版本 4 UUID，例如 1b4e28ba-2fa1-41d2-883f-0016d3cca427
+    static std::vector<std::string> uuids(unsigned long n, uint64_t seed) {
+        auto rng = engine(seed, 5);
+        std::vector<std::string> result(n);
+        for (auto &uuid: result) {
+            uuid = hex(rng, 8) + '-' + hex(rng, 4) + "-4" + hex(rng, 3) + '-' + hex(rng, 4) + '-' + hex(rng, 12);
+            uuid[19] = "89ab"[rng() & 3];
+        }
+        return result;
+    }
+
+    /// n 次操作，读、写、删除的比例为 read : write : erase。第 i 次操作的 key 是 keys[i % keys.size()]，
+    /// 所以 key 的分布由 keys 决定，例如 Zipf 分布的排名
+    static std::vector<Operation> mix(unsigned long n, const std::vector<unsigned long> &keys,
+                                      double read, double write, double erase, uint64_t seed) {
+        auto rng = engine(seed, 6);
+        std::discrete_distribution<int> dist({ read, write, erase });
+        std::vector<Operation> ops(n);
+        for (unsigned long i = 0; i < n; i++)
+            ops[i] = { (Op)dist(rng), keys[i % keys.size()] };
+        return ops;
+    }
+
+    /// n 个不同的非负整数，在 2^bits 个位置的 hash 部分中都落在位置 0。
+    /// hash_INT 是恒等映射，所以 LOW_BITS 直接取 2^bits 的倍数；
+    /// FIBONACCI 取 j 乘以黄金分割常数的逆元，乘回去之后恰好是 j，高位都是 0
+    static std::vector<Integer> int_collisions(unsigned long n, unsigned bits, Bucketing bucketing) {
+        std::vector<Integer> keys;
+        keys.reserve(n);
+        auto inv = inverse(0x9E3779B97F4A7C15ull);
+        for (uint64_t j = 1; keys.size() < n; j++) {
+            auto h = bucketing == LOW_BITS ? j << bits : j * inv;
+            if (h >> 63 == 0) // hash_INT never produces the upper half
+                keys.push_back((Integer)h);
+        }
+        return keys;
+    }
+
+    /// n 个不同的浮点数，每 2^15 个的 hash 完全相同：hash_NUM 只用尾数的高 31 位与指数，
+    /// 1 + k * 2^-45 在 k < 2^15 时只在更低的位上不同。任何布局都只能逐个比较它们，但不能因此拒绝插入
+    static std::vector<Number> equal_hashes(unsigned long n) {
+        std::vector<Number> keys;
+        keys.reserve(n);
+        for (unsigned long k = 0; k < n; k++)
+            keys.push_back(1.0 + std::ldexp((Number)k, -45));
+        return keys;
+    }
+
+    /// n 个不同的字符串，在 2^bits 个位置的 hash 部分中都落在同一个位置。
+    /// hash_STR 每个字符都把高位移到低位，构造不出来，只能逐个尝试，期望代价是每个结果 2^bits 次 hash
+    static std::vector<std::string> string_collisions(unsigned long n, unsigned bits, Bucketing bucketing, uint64_t seed) {
+        auto rng = engine(seed, 7);
+        auto bucket = [&](Hash h) {
+            return bucketing == LOW_BITS ? h & ((1ull << bits) - 1) : (h * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+        };
+
+        std::vector<std::string> result;
+        auto prefix = "k" + hex(rng, 6) + '-';
+        for (uint64_t i = 0; result.size() < n; i++) {
+            auto s = prefix + std::to_string(i);
+            if (bucket(Key::hash_STR(s)) == 0)
+                result.push_back(std::move(s));
+        }
+        return result;
+    }
+};
+
+#endif //TABLE_WORKLOAD_H
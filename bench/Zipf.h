@@ -0,0 +1,32 @@
+#ifndef TABLE_ZIPF_H
+#define TABLE_ZIPF_H
+
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+/// 服从 Zipf 分布的随机数，取值为 [0, n)，取到 k 的概率正比于 1 / (k + 1)^s。
+/// 预先算出累积分布，每次取值做一次二分
+class Zipf {
+private:
+    std::vector<double> cdf;
+
+public:
+    Zipf(unsigned long n, double s): cdf(n) {
+        double sum = 0;
+        for (unsigned long k = 0; k < n; k++)
+            cdf[k] = sum += 1 / std::pow((double)(k + 1), s);
+        for (auto &c: cdf)
+            c /= sum;
+    }
+
+    template<class Generator>
+    unsigned long operator () (Generator &g) {
+        auto u = std::uniform_real_distribution<double>(0, 1)(g);
+        auto k = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        return std::min<unsigned long>(k, cdf.size() - 1);
+    }
+};
+
+#endif //TABLE_ZIPF_H
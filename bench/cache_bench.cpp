@@ -0,0 +1,92 @@
+#include <iostream>
+#include <list>
+#include "Table.h"
+#include "Zipf.h"
+
+using namespace std;
+
+// What callers do today: a Table from key to a position in an external recency list.
+class ListLru {
+private:
+    Table table;
+    list<Integer> order;
+    unsigned long capacity;
+
+public:
+    explicit ListLru(unsigned long capacity): capacity(capacity) {}
+
+    bool get(Integer key) {
+        auto value = table.query(Key(key));
+        if (!value.has_value())
+            return false;
+        auto it = any_cast<list<Integer>::iterator>(**value);
+        order.splice(order.begin(), order, it);
+        return true;
+    }
+
+    void put(Integer key) {
+        if (order.size() >= capacity) {
+            table.erase(Key(order.back()));
+            order.pop_back();
+        }
+        order.push_front(key);
+        table.insert(Key(key), make_shared<Value>(order.begin()));
+    }
+};
+
+class Clock {
+private:
+    Table table;
+
+public:
+    explicit Clock(unsigned long capacity): table(0, 1, COMPACT) {
+        table.set_capacity(capacity);
+    }
+
+    bool get(Integer key) {
+        return table.query(Key(key)).has_value();
+    }
+
+    void put(Integer key) {
+        table.insert(Key(key), make_shared<Value>(key));
+    }
+};
+
+template<class Cache>
+void run(const char *name, const vector<Integer> &trace, unsigned long capacity, double s) {
+    Cache cache(capacity);
+    unsigned long hits = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (auto key: trace) {
+        if (cache.get(key))
+            hits++;
+        else
+            cache.put(key);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << name << "\ts=" << s << "\tcapacity=" << capacity
+         << "\thit=" << (double)hits / trace.size()
+         << "\tMops/s=" << trace.size() / elapsed.count() / 1e6 << endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned long keys = argc > 1 ? stoul(argv[1]) : 1000000;
+    unsigned long length = argc > 2 ? stoul(argv[2]) : 10000000;
+
+    for (auto s: { 0.8, 0.99, 1.2 }) {
+        Zipf zipf(keys, s);
+        mt19937_64 rng(s * 1000);
+
+        // scatter the ranks so that hot keys are not neighbours
+        vector<Integer> trace(length);
+        for (auto &key: trace)
+            key = (Integer)(zipf(rng) * 0xD6E8FEB86659FD93ull >> 1);
+
+        for (auto capacity: { keys / 100, keys / 10 }) {
+            run<ListLru>("list-lru", trace, capacity, s);
+            run<Clock>("clock", trace, capacity, s);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include "Table.h"
+#include "CounterTable.h"
+#include "Zipf.h"
+
+using namespace std;
+
+// What callers do today: one Table behind one mutex.
+class LockedTable {
+private:
+    Table table;
+    mutex lock;
+
+public:
+    void add(Integer key) {
+        lock_guard<mutex> guard(lock);
+        table[key] += 1ll;
+    }
+
+    int64_t get(Integer key) {
+        lock_guard<mutex> guard(lock);
+        auto value = table.query(Key(key));
+        return value.has_value() ? any_cast<long long>(**value) : 0;
+    }
+};
+
+class Counters {
+private:
+    CounterTable table;
+
+public:
+    void add(Integer key) {
+        table[key] += 1;
+    }
+
+    int64_t get(Integer key) {
+        return table.get(Key(key));
+    }
+};
+
+template<class Counter>
+void run(const char *name, const vector<vector<Integer>> &traces, unsigned long keys, double s) {
+    Counter counter;
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (auto &trace: traces)
+        threads.emplace_back([&] {
+            for (auto key: trace)
+                counter.add(key);
+        });
+    for (auto &t: threads)
+        t.join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    unsigned long operations = 0, total = 0;
+    for (auto &trace: traces)
+        operations += trace.size();
+    for (unsigned long rank = 0; rank < keys; rank++)
+        total += counter.get((Integer)(rank * 0xD6E8FEB86659FD93ull >> 1));
+
+    cout << name << "\ts=" << s << "\tthreads=" << traces.size()
+         << "\tMops/s=" << operations / elapsed.count() / 1e6
+         << (total == operations ? "" : "\tLOST UPDATES") << endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned long keys = argc > 1 ? stoul(argv[1]) : 1000000;
+    unsigned long length = argc > 2 ? stoul(argv[2]) : 4000000;
+    unsigned max_threads = argc > 3 ? stoul(argv[3]) : max(1u, thread::hardware_concurrency());
+
+    for (auto s: { 0.99, 1.2 }) {
+        Zipf zipf(keys, s);
+        for (unsigned n = 1; n <= max_threads; n *= 2) {
+            // the same total number of increments, split between the threads
+            vector<vector<Integer>> traces(n);
+            for (unsigned i = 0; i < n; i++) {
+                mt19937_64 rng(i + 1);
+                traces[i].resize(length / n);
+                for (auto &key: traces[i])
+                    key = (Integer)(zipf(rng) * 0xD6E8FEB86659FD93ull >> 1);
+            }
+            run<LockedTable>("mutex+table", traces, keys, s);
+            run<Counters>("counter-table", traces, keys, s);
+        }
+    }
+}
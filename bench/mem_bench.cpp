@@ -0,0 +1,144 @@
+#include <iostream>
+#include <malloc.h>
+#include <new>
+#include "Table.h"
+
+using namespace std;
+
+// Every operator new of the process goes through these, sizes are what the allocator really hands out.
+// The array part is allocated with calloc or mmap instead, Table::array_bytes() reports it.
+static unsigned long live_bytes = 0, live_allocs = 0;
+
+static void* track(void* p) {
+    if (p == nullptr)
+        throw bad_alloc();
+    live_bytes += malloc_usable_size(p), live_allocs++;
+    return p;
+}
+
+static void untrack(void* p) {
+    if (p == nullptr)
+        return;
+    live_bytes -= malloc_usable_size(p), live_allocs--;
+    free(p);
+}
+
+void* operator new (size_t n) { return track(malloc(n)); }
+void* operator new[] (size_t n) { return track(malloc(n)); }
+void* operator new (size_t n, align_val_t a) { return track(aligned_alloc((size_t)a, (n + (size_t)a - 1) / (size_t)a * (size_t)a)); }
+void* operator new[] (size_t n, align_val_t a) { return operator new(n, a); }
+void operator delete (void* p) noexcept { untrack(p); }
+void operator delete[] (void* p) noexcept { untrack(p); }
+void operator delete (void* p, size_t) noexcept { untrack(p); }
+void operator delete[] (void* p, size_t) noexcept { untrack(p); }
+void operator delete (void* p, align_val_t) noexcept { untrack(p); }
+void operator delete[] (void* p, align_val_t) noexcept { untrack(p); }
+void operator delete (void* p, size_t, align_val_t) noexcept { untrack(p); }
+void operator delete[] (void* p, size_t, align_val_t) noexcept { untrack(p); }
+
+enum Format { CSV, JSON };
+
+struct Sample {
+    const char *event; // "resize" right after a resize, "final" once everything is inserted
+    unsigned long entries, array_size_log2, hash_size_log2, bytes, allocs;
+};
+
+// Records the footprint right after every resize, into storage reserved up front so that
+// recording doesn't allocate. The value of the key being inserted is already allocated but not counted
+// in the entries.
+class Recorder: public IResizeObserver {
+public:
+    vector<Sample> samples;
+    unsigned long base_bytes = 0, base_allocs = 0;
+    const Table *table = nullptr;
+
+    Recorder() {
+        samples.reserve(1024);
+    }
+
+    void after_resize(const ResizeEvent &event) override {
+        if (samples.size() < samples.capacity())
+            samples.push_back({ "resize", event.array_entries + event.hash_entries,
+                                event.new_array_size_log2, event.new_hash_size_log2,
+                                live_bytes - base_bytes + table->array_bytes(), live_allocs - base_allocs });
+    }
+};
+
+// The i-th key of each kind. Dense integers fill the array part, the others all land in the hash part.
+Key make_key(const string &kind, unsigned long i) {
+    auto scattered = i * 0xD6E8FEB86659FD93ull;
+    if (kind == "int_dense") return Key((Integer)i);
+    if (kind == "int_sparse") return Key((Integer)(scattered >> 1));
+    if (kind == "num") return Key((Number)i + 0.5);
+    if (kind == "str_short") return Key("k" + to_string(i)); // fits in the small string buffer
+    if (kind == "str_long") return Key("https://example.com/items/" + to_string(scattered));
+    if (kind == "ptr") return Key((void*)(uintptr_t)(scattered & ~7ull));
+    return Key(Int((long long)scattered));
+}
+
+shared_ptr<Value> make_value(const string &kind, unsigned long i) {
+    if (kind == "int") return make_shared<Value>((long long)i);
+    if (kind == "str32") return make_shared<Value>(string(32, 'v'));
+    return make_shared<Value>(vector<char>(256));
+}
+
+// What the value alone costs, subtract it from bytes_per_entry to get the table and key overhead.
+double value_bytes(const string &kind) {
+    vector<shared_ptr<Value>> values;
+    values.reserve(1000);
+    auto reserved = live_bytes;
+    for (unsigned long i = 0; i < 1000; i++)
+        values.push_back(make_value(kind, i));
+    return (double)(live_bytes - reserved) / 1000;
+}
+
+void print(Format format, Layout layout, const string &key, const string &value, double per_value, const Sample &s) {
+    auto per_entry = [&](unsigned long x) { return s.entries ? (double)x / s.entries : 0.0; };
+    if (format == CSV) {
+        cout << layout_name(layout) << ',' << key << ',' << value << ',' << s.event << ',' << s.entries << ','
+             << s.array_size_log2 << ',' << s.hash_size_log2 << ',' << s.bytes << ',' << s.allocs << ','
+             << per_entry(s.bytes) << ',' << per_entry(s.allocs) << ',' << per_value << '\n';
+    } else {
+        cout << "{\"layout\":\"" << layout_name(layout) << "\",\"key\":\"" << key << "\",\"value\":\"" << value
+             << "\",\"event\":\"" << s.event << "\",\"entries\":" << s.entries
+             << ",\"array_size_log2\":" << s.array_size_log2 << ",\"hash_size_log2\":" << s.hash_size_log2
+             << ",\"bytes\":" << s.bytes << ",\"allocs\":" << s.allocs
+             << ",\"bytes_per_entry\":" << per_entry(s.bytes) << ",\"allocs_per_entry\":" << per_entry(s.allocs)
+             << ",\"value_bytes\":" << per_value << "}\n";
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned long entries = argc > 1 ? stoul(argv[1]) : 1000000;
+    auto format = argc > 2 && string(argv[2]) == "json" ? JSON : CSV;
+    register_hashes();
+
+    if (format == CSV)
+        cout << "layout,key,value,event,entries,array_size_log2,hash_size_log2,bytes,allocs,"
+                "bytes_per_entry,allocs_per_entry,value_bytes\n";
+
+    for (auto layout: { CHAINED, TAGGED, RADIX, COMPACT, EXTENDIBLE })
+        for (string key: { "int_dense", "int_sparse", "num", "str_short", "str_long", "ptr", "h" })
+            for (string value: { "int", "str32", "vec256" }) {
+                auto per_value = value_bytes(value);
+                auto recorder = make_shared<Recorder>();
+                recorder->base_bytes = live_bytes, recorder->base_allocs = live_allocs;
+                {
+                    Table table(0, 1, layout);
+                    table.add_observer(recorder);
+                    recorder->table = &table;
+
+                    for (unsigned long i = 0; i < entries; i++)
+                        table.insert(make_key(key, i), make_value(value, i));
+
+                    Sample last{ "final", entries, 0, 1, 0, 0 };
+                    if (!recorder->samples.empty())
+                        last = recorder->samples.back(), last.event = "final", last.entries = entries;
+                    last.bytes = live_bytes - recorder->base_bytes + table.array_bytes(), last.allocs = live_allocs - recorder->base_allocs;
+                    recorder->samples.push_back(last);
+                }
+                for (auto &sample: recorder->samples)
+                    print(format, layout, key, value, per_value, sample);
+                cout.flush();
+            }
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+#include "Table.h"
+#include "Workload.h"
+
+using namespace std;
+
+// Latency of every single insert, the tail shows the rehash pauses. Between two inserts the
+// caller spins for work_ns, as a service handling requests would.
+void run(Layout layout, bool background, unsigned long keys, unsigned long work_ns) {
+    Table table(0, 1, layout);
+    table.set_background_rehash(background);
+    auto value = make_shared<Value>(1ll);
+
+    vector<double> latency(keys);
+    auto start = chrono::steady_clock::now();
+    for (unsigned long rank = 0; rank < keys; rank++) {
+        auto before = chrono::steady_clock::now();
+        table.insert(Key(Workload::scatter(rank)), value);
+        auto after = chrono::steady_clock::now();
+        latency[rank] = chrono::duration<double, micro>(after - before).count();
+        while (chrono::steady_clock::now() - after < chrono::nanoseconds(work_ns))
+            ;
+    }
+    table.finish_rehash();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    sort(latency.begin(), latency.end());
+    auto percentile = [&](double p) { return latency[min(keys - 1, (unsigned long)(p * keys))]; };
+    cout << layout_name(layout) << (background ? "\tbackground" : "\tinline") << "\tMops/s=" << keys / elapsed.count() / 1e6
+         << "\tp99us=" << percentile(0.99) << "\tp99.99us=" << percentile(0.9999) << "\tmax_us=" << latency.back() << endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned long keys = argc > 1 ? stoul(argv[1]) : 4000000;
+    unsigned long work_ns = argc > 2 ? stoul(argv[2]) : 1000;
+    for (auto layout: { CHAINED, TAGGED, RADIX, COMPACT, EXTENDIBLE }) {
+        run(layout, false, keys, work_ns);
+        run(layout, true, keys, work_ns);
+    }
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <thread>
+#include "Table.h"
+#include "Workload.h"
+
+using namespace std;
+
+// Concurrent readers of one table. Nothing writes during the run, so both lookups are safe to share.
+template<class Read>
+void run(const char *name, const vector<vector<Integer>> &traces, Read read) {
+    vector<long long> sums(traces.size());
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (size_t t = 0; t < traces.size(); t++)
+        threads.emplace_back([&, t] {
+            long long sum = 0;
+            for (auto key: traces[t])
+                sum += read(key);
+            sums[t] = sum;
+        });
+    for (auto &thread: threads)
+        thread.join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    unsigned long operations = 0;
+    for (auto &trace: traces)
+        operations += trace.size();
+    cout << name << "\tthreads=" << traces.size() << "\tMops/s=" << operations / elapsed.count() / 1e6 << endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned long keys = argc > 1 ? stoul(argv[1]) : 100000;
+    unsigned long length = argc > 2 ? stoul(argv[2]) : 10000000;
+    unsigned max_threads = argc > 3 ? stoul(argv[3]) : max(1u, thread::hardware_concurrency());
+
+    for (auto layout: { CHAINED, COMPACT }) {
+        Table table(0, 1, layout);
+        for (unsigned long rank = 0; rank < keys; rank++)
+            table.insert(Key(Workload::scatter(rank)), make_shared<Value>(1ll));
+
+        for (unsigned n = 1; n <= max_threads; n *= 2) {
+            // a skewed trace, so that the threads keep hitting the same few entries
+            vector<vector<Integer>> traces;
+            for (unsigned t = 0; t < n; t++)
+                traces.push_back(Workload::zipf(length / n, keys, 1.2, t + 1));
+
+            cout << (layout == CHAINED ? "CHAINED\t" : "COMPACT\t");
+            run("query", traces, [&](Integer key) {
+                auto value = table.query(Key(key));
+                return value.has_value() ? any_cast<long long>(**value) : 0;
+            });
+            cout << (layout == CHAINED ? "CHAINED\t" : "COMPACT\t");
+            run("find", traces, [&](Integer key) {
+                auto value = table.find(Key(key));
+                return value != nullptr ? any_cast<long long>(*value) : 0;
+            });
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <fstream>
+#include <unistd.h>
+#include "Table.h"
+#include "Workload.h"
+
+using namespace std;
+
+// The largest parts the table has grown to.
+struct Sizes: IResizeObserver {
+    unsigned long array_log2 = 0, hash_log2 = 0;
+
+    void after_resize(const ResizeEvent &event) override {
+        array_log2 = max(array_log2, event.new_array_size_log2);
+        hash_log2 = max(hash_log2, event.new_hash_size_log2);
+    }
+};
+
+unsigned long resident_bytes() {
+    unsigned long pages = 0, resident = 0;
+    ifstream("/proc/self/statm") >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// High-water mark of the resident set, which catches the moment a resize holds both copies.
+unsigned long peak_bytes() {
+    ifstream status("/proc/self/status");
+    string field;
+    unsigned long kb = 0;
+    while (status >> field)
+        if (field == "VmHWM:" && status >> kb)
+            break;
+    return kb * 1024;
+}
+
+// Half of the keys are dense and go to the array part, the other half are scattered over the
+// hash part. Each stage doubles the table and is reported on its own, so a run up to 2^33 keys
+// shows both parts crossing 2^31 and 2^32 slots.
+void run(Layout layout, unsigned max_log2, bool paged) {
+    Table table(0, 1, layout);
+    table.set_paged_array(paged);
+    auto sizes = make_shared<Sizes>();
+    table.add_observer(sizes);
+    auto value = make_shared<Value>(1ll);
+    auto key = [](unsigned long i) { return i % 2 ? Workload::scatter(i / 2) | (1l << 61) : (Integer)(i / 2); };
+
+    auto base = resident_bytes();
+    unsigned long inserted = 0;
+    for (unsigned log2 = 20; log2 <= max_log2; log2++) {
+        auto target = 1ul << log2, first = inserted;
+        auto start = chrono::steady_clock::now();
+        try {
+            for (; inserted < target; inserted++)
+                table.insert(Key(key(inserted)), value);
+        } catch (const length_error &e) {
+            cout << layout_name(layout) << "\tentries=" << inserted << "\tstopped: " << e.what() << endl;
+            return;
+        }
+        chrono::duration<double> insert = chrono::steady_clock::now() - start;
+
+        // look up a sample spread over everything inserted so far
+        const unsigned long SAMPLE = 1 << 20;
+        unsigned long found = 0;
+        start = chrono::steady_clock::now();
+        for (unsigned long i = 0; i < SAMPLE; i++)
+            found += table.find(Key(key(Workload::scatter(i) % target))) != nullptr;
+        chrono::duration<double> lookup = chrono::steady_clock::now() - start;
+        if (found != SAMPLE) {
+            cout << layout_name(layout) << "\tentries=" << target << "\tlost " << SAMPLE - found << " keys" << endl;
+            return;
+        }
+
+        cout << layout_name(layout) << "\tentries=2^" << log2
+             << "\tinsert Mops/s=" << (target - first) / insert.count() / 1e6
+             << "\tfind Mops/s=" << SAMPLE / lookup.count() / 1e6
+             << "\tarray=2^" << sizes->array_log2 << "\thash=2^" << sizes->hash_log2
+             << "\tbytes/entry=" << (double)(resident_bytes() - base) / target
+             << "\tpeak bytes/entry=" << (double)(peak_bytes() - base) / target << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    // 2^33 entries take several hundred GB, the default fits a workstation
+    unsigned max_log2 = argc > 1 ? stoul(argv[1]) : 24;
+    // memory freed by one layout is reused by the next, name a single layout for exact bytes/entry
+    string only = argc > 2 && string(argv[2]) != "all" ? argv[2] : "";
+    // "paged" as the third argument uses the paged array part
+    bool paged = argc > 3 && string(argv[3]) == "paged";
+    for (auto layout: { CHAINED, TAGGED, RADIX, COMPACT, EXTENDIBLE })
+        if (only.empty() || only == layout_name(layout))
+            run(layout, max_log2, paged);
+}
@@ -0,0 +1,40 @@
+#include <iostream>
+#include "Parallel.h"
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    unsigned long entries = argc > 1 ? stoul(argv[1]) : 10000000;
+    unsigned max_threads = argc > 2 ? stoul(argv[2]) : max(1u, thread::hardware_concurrency());
+
+    // half of the keys are dense and land in the array part, the other half are scattered over the hash part
+    Table table;
+    for (unsigned long i = 0; i < entries / 2; i++)
+        table[(Integer)i] = 1ll;
+    for (unsigned long i = 0; i < entries - entries / 2; i++)
+        table[(Integer)((i + 1) * 0xD6E8FEB86659FD93ull >> 1)] = 1ll;
+
+    auto time = [](auto f) {
+        auto start = chrono::steady_clock::now();
+        auto result = f();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        return make_pair(result, elapsed.count());
+    };
+
+    auto [sequential, seconds] = time([&] {
+        long long sum = 0;
+        table.for_each([&](const Key &, shared_ptr<Value> &value) { sum += any_cast<long long>(*value); });
+        return sum;
+    });
+    cout << "for_each\tthreads=1\tMentries/s=" << entries / seconds / 1e6 << endl;
+
+    for (unsigned n = 1; n <= max_threads; n *= 2) {
+        ThreadPool pool(n);
+        auto [sum, seconds] = time([&] {
+            return Parallel::reduce(table, 0ll, [](const Key &, const Value &value) { return any_cast<long long>(value); },
+                                    plus<long long>(), pool);
+        });
+        cout << "reduce\tthreads=" << n << "\tMentries/s=" << entries / seconds / 1e6
+             << (sum == sequential ? "" : "\tWRONG SUM") << endl;
+    }
+}
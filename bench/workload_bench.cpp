@@ -0,0 +1,113 @@
+#include <iostream>
+#include "Table.h"
+#include "Workload.h"
+#include "PerfCounters.h"
+
+using namespace std;
+
+// Prints every layout switch of the adaptive mode.
+struct LayoutLog: IResizeObserver {
+    void after_resize(const ResizeEvent &event) override {
+        if (event.old_layout == event.new_layout)
+            return;
+        cout << "\tswitch " << layout_name(event.old_layout) << " -> " << layout_name(event.new_layout)
+             << " at hash=2^" << event.new_hash_size_log2 << ": " << event.layout_reason
+             << " (sampled " << event.sampled_lookups << " lookups, " << event.sampled_misses << " misses, "
+             << event.sampled_steps << " nodes compared in " << event.sampled_walks << " chain walks)" << endl;
+    }
+};
+
+// Inserts every key, then replays the operations against them. The adaptive run starts from
+// CHAINED and is reported under the layout it ends with.
+template<class K>
+void run(const char *name, Layout layout, const vector<K> &keys, const vector<Operation> &ops, PerfCounters &counters, bool adaptive = false) {
+    Table table(0, 1, layout);
+    table.set_adaptive_layout(adaptive);
+    if (adaptive)
+        table.add_observer(make_shared<LayoutLog>());
+    auto value = make_shared<Value>(1ll);
+
+    auto start = chrono::steady_clock::now();
+    counters.start();
+    for (auto &key: keys)
+        table.insert(Key(key), value);
+    counters.stop();
+    auto inserted = counters.per_operation(keys.size());
+    auto middle = chrono::steady_clock::now();
+
+    counters.start();
+    unsigned long hits = 0;
+    for (auto &op: ops) {
+        auto &key = keys[op.key];
+        switch (op.op) {
+            case READ: hits += table.query(Key(key)).has_value(); break;
+            case WRITE: table.insert(Key(key), value); break;
+            case ERASE: table.erase(Key(key)); break;
+        }
+    }
+    counters.stop();
+    auto end = chrono::steady_clock::now();
+
+    chrono::duration<double> insert = middle - start, mixed = end - middle;
+    cout << (adaptive ? "ADAPTIVE:" : "") << layout_name(table.get_layout()) << '\t' << name << "\tkeys=" << keys.size()
+         << "\tinsert Mops/s=" << keys.size() / insert.count() / 1e6 << inserted
+         << "\tmix Mops/s=" << ops.size() / mixed.count() / 1e6 << counters.per_operation(ops.size())
+         << "\thit=" << (double)hits / ops.size() << endl;
+}
+
+int main(int argc, char **argv) {
+    unsigned long n = argc > 1 ? stoul(argv[1]) : 200000;
+    unsigned long length = argc > 2 ? stoul(argv[2]) : 1000000;
+    uint64_t seed = argc > 3 ? stoull(argv[3]) : 1;
+    // a successful attack makes every operation linear, keep those runs small
+    unsigned long attack = n / 10, attack_length = length / 10;
+
+    // 80% reads, 15% writes, 5% erases over Zipf-distributed ranks
+    auto ops = Workload::mix(length, Workload::zipf_ranks(length, n, 0.99, seed), 0.8, 0.15, 0.05, seed);
+    auto attack_ops = Workload::mix(attack_length, Workload::zipf_ranks(attack_length, attack, 0.99, seed), 0.8, 0.15, 0.05, seed);
+
+    auto sequential = Workload::sequential(n);
+    auto strided = Workload::strided(n, 3);
+    auto clustered = Workload::clustered(n, 64, seed);
+    auto uniform = Workload::uniform(n, 1ull << 62, seed);
+    auto urls = Workload::urls(n, seed);
+    auto uuids = Workload::uuids(n, seed);
+
+    // collide in every table of up to 2^16 hash slots
+    auto low_ints = Workload::int_collisions(attack, 16, Workload::LOW_BITS);
+    auto fib_ints = Workload::int_collisions(attack, 16, Workload::FIBONACCI);
+    auto low_strs = Workload::string_collisions(attack, 12, Workload::LOW_BITS, seed);
+    auto fib_strs = Workload::string_collisions(attack, 12, Workload::FIBONACCI, seed);
+    // no layout may give up on these, see Workload::equal_hashes
+    auto same_nums = Workload::equal_hashes(attack);
+
+    PerfCounters counters;
+    if (!counters.available())
+        cerr << "hardware counters unavailable (" << counters.unavailable_reason() << "), reporting time only" << endl;
+
+    for (auto layout: { CHAINED, TAGGED, RADIX, COMPACT, EXTENDIBLE }) {
+        run("sequential", layout, sequential, ops, counters);
+        run("strided", layout, strided, ops, counters);
+        run("clustered", layout, clustered, ops, counters);
+        run("uniform", layout, uniform, ops, counters);
+        run("urls", layout, urls, ops, counters);
+        run("uuids", layout, uuids, ops, counters);
+        run("int-collide-low", layout, low_ints, attack_ops, counters);
+        run("int-collide-fib", layout, fib_ints, attack_ops, counters);
+        run("str-collide-low", layout, low_strs, attack_ops, counters);
+        run("str-collide-fib", layout, fib_strs, attack_ops, counters);
+        run("num-same-hash", layout, same_nums, attack_ops, counters);
+    }
+
+    run("sequential", CHAINED, sequential, ops, counters, true);
+    run("strided", CHAINED, strided, ops, counters, true);
+    run("clustered", CHAINED, clustered, ops, counters, true);
+    run("uniform", CHAINED, uniform, ops, counters, true);
+    run("urls", CHAINED, urls, ops, counters, true);
+    run("uuids", CHAINED, uuids, ops, counters, true);
+    run("int-collide-low", CHAINED, low_ints, attack_ops, counters, true);
+    run("int-collide-fib", CHAINED, fib_ints, attack_ops, counters, true);
+    run("str-collide-low", CHAINED, low_strs, attack_ops, counters, true);
+    run("str-collide-fib", CHAINED, fib_strs, attack_ops, counters, true);
+    run("num-same-hash", CHAINED, same_nums, attack_ops, counters, true);
+}